@@ -0,0 +1,82 @@
+#include <multilayerPerceptron.cpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Returns the mean time of a call to f in microseconds, after a few warm up calls. The iterations are split into
+// five rounds and the fastest round counts, which keeps other load on the machine out of the comparison.
+template <typename F>
+double microseconds(F f, int iterations) {
+    for (int i = 0; i < 10; i++) f();
+
+    double fastest = 0.0;
+    for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations / 5; i++) f();
+        std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+        double mean = time.count() / (iterations / 5);
+        if (round == 0 || mean < fastest) fastest = mean;
+    }
+    return fastest;
+}
+
+// Compares a full forward pass (MLP::infer) against an update of an incremental session (MLP::updateSession) that changes
+// the given number of pixels, a stroke of neighbouring pixels like the canvas of the front end sends, and how far their
+// outputs are apart after many updates.
+template <typename T>
+void compare(const std::string& name, const MLP<T>& model, int changed, int iterations) {
+    std::default_random_engine re(changed);
+    std::uniform_real_distribution<double> unif(0, 1);
+    std::uniform_int_distribution<int> start(0, 784 - changed);
+
+    std::vector<T> pixels(784, 0);
+    typename MLP<T>::inferenceBuffers buffers = model.createInferenceBuffers();
+    typename MLP<T>::inferenceSession session = model.createSession(basicMatrixView<T>(pixels.data(), 784, 1, 1, 1));
+
+    auto stroke = [&]() {
+        std::vector<typename MLP<T>::inputChange> changes;
+        int first = start(re);
+        for (int i = first; i < first + changed; i++) {
+            T value = unif(re);
+            changes.push_back({ i, value });
+            pixels[i] = value;
+        }
+        return changes;
+    };
+
+    double maxDifference = 0.0;
+    for (int i = 0; i < 1000; i++) {
+        const basicMatrix<T>& outputs = model.updateSession(session, stroke());
+        const basicMatrix<T>& expected = model.infer(basicMatrixView<T>(pixels.data(), 784, 1, 1, 1), buffers);
+        for (int j = 0; j < outputs.getRows(); j++) {
+            maxDifference = std::max(maxDifference, (double)std::abs(outputs(j, 0) - expected(j, 0)));
+        }
+    }
+
+    // The strokes are made outside the timed calls.
+    std::vector<std::vector<typename MLP<T>::inputChange>> strokes;
+    for (int i = 0; i < 64; i++) strokes.push_back(stroke());
+    int next = 0;
+
+    double fullTime = microseconds([&]() { model.infer(basicMatrixView<T>(pixels.data(), 784, 1, 1, 1), buffers); }, iterations);
+    double incrementalTime = microseconds([&]() { model.updateSession(session, strokes[next++ % strokes.size()]); }, iterations);
+
+    std::cout << name << ", " << changed << " pixels: infer " << fullTime << " us, updateSession " << incrementalTime << " us, speedup " << fullTime / incrementalTime << "x" << std::endl;
+    std::cout << "    Max output difference: " << std::scientific << maxDifference << std::fixed << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000;
+
+    // Random weights, the latency does not depend on their values.
+    MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 25});
+    MLP<float> floatModel = MLP<float>(model);
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (int changed : { 10, 50, 100, 300 }) {
+        compare("double", model, changed, iterations);
+        compare("float", floatModel, changed, iterations);
+    }
+}
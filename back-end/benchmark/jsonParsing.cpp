@@ -0,0 +1,91 @@
+#include <jsonPixelParser.cpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Returns the mean time of a call to f in microseconds, after a few warm up calls.
+template <typename F>
+double microseconds(F f, int iterations) {
+    for (int i = 0; i < 10; i++) f();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) f();
+    std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+    return time.count() / iterations;
+}
+
+// A body like the front end sends, 784 pixels divided by 255 and printed the way JavaScript prints them. Most of a drawing is
+// blank, so about four in five pixels are 0.
+std::string randomBody() {
+    std::default_random_engine re(0);
+    std::uniform_int_distribution<int> pixel(1, 255);
+    std::bernoulli_distribution blank(0.8);
+
+    std::string body = "[";
+    char number[32];
+    for (int i = 0; i < 784; i++) {
+        if (i > 0) body += ",";
+        if (blank(re)) {
+            body += "0";
+            continue;
+        }
+        snprintf(number, sizeof(number), "%.17g", pixel(re) * (1.0 / 255.0));
+        body += number;
+    }
+    return body + "]";
+}
+
+// Compares parsing a JSON /predict body through a nlohmann::json DOM, the way parseBody used to, against jsonPixelParser fed
+// the whole body at once and fed it in chunks like uWS delivers a body split across packets.
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 5000;
+    std::string body = randomBody();
+    const int chunkSize = 512;
+
+    std::vector<double> dom;
+    double domTime = microseconds([&]() {
+        nlohmann::json j = nlohmann::json::parse(body);
+        dom.clear();
+        for (auto& x : j.items()) {
+            dom.push_back(x.value());
+        }
+    }, iterations);
+
+    std::vector<double> whole;
+    double wholeTime = microseconds([&]() {
+        jsonPixelParser<double> parser(784);
+        parser.consume(body);
+        whole = parser.finish();
+    }, iterations);
+
+    std::vector<double> chunked;
+    double chunkedTime = microseconds([&]() {
+        jsonPixelParser<double> parser(784);
+        for (size_t i = 0; i < body.size(); i += chunkSize) {
+            parser.consume(std::string_view(body).substr(i, chunkSize));
+        }
+        chunked = parser.finish();
+    }, iterations);
+
+    if (dom != whole || dom != chunked) {
+        std::cout << "The parsers disagree." << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Body of " << body.size() << " bytes." << std::endl;
+    std::cout << std::setw(28) << "Parser" << std::setw(12) << "Time (us)" << std::setw(10) << "MB/s" << std::setw(10) << "Speedup" << std::endl;
+    auto report = [&](const std::string& name, double time) {
+        std::cout << std::setw(28) << name << std::setw(12) << time << std::setw(10) << body.size() / time << std::setw(9) << domTime / time << "x" << std::endl;
+    };
+    report("nlohmann::json DOM", domTime);
+    report("jsonPixelParser", wholeTime);
+    report("jsonPixelParser, " + std::to_string(chunkSize) + " B chunks", chunkedTime);
+}
@@ -0,0 +1,87 @@
+#include <matrix.h>
+#include <activation.h>
+#include <gemm.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Returns the mean time of a call to f in microseconds, after a few warm up calls.
+template <typename F>
+double microseconds(F f, int iterations) {
+    for (int i = 0; i < 10; i++) f();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) f();
+    std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+    return time.count() / iterations;
+}
+
+// Compares the per layer latency of a single prediction through the served network, unfused (the product with
+// the biases, then a separate sigmoid pass through matrix::map) against matrix::matrixMultiplyAddSigmoid.
+template <typename T>
+void compareLayers(const std::string& name, const std::vector<int>& sizes, int iterations) {
+    typedef basicMatrix<T> matrix_t;
+
+    std::default_random_engine re(0);
+    std::uniform_real_distribution<T> unif(-1, 1);
+    auto randomMatrix = [&](int rows, int columns) {
+        std::vector<T> data(rows * columns);
+        for (T& value : data) value = unif(re);
+        return matrix_t(data, rows, columns);
+    };
+
+    std::cout << name << std::endl;
+    std::cout << std::setw(14) << "Layer" << std::setw(14) << "Unfused (us)" << std::setw(12) << "Fused (us)" << std::setw(10) << "Speedup"
+        << std::setw(16) << "Max difference" << std::endl;
+
+    double unfusedTotal = 0.0;
+    double fusedTotal = 0.0;
+    matrix_t input = matrix_t::map(randomMatrix(sizes[0], 1), [](T x) { return (x + 1) / 2; });
+
+    for (int layer = 0; layer + 1 < sizes.size(); layer++) {
+        matrix_t weights = randomMatrix(sizes[layer + 1], sizes[layer]);
+        matrix_t biases = randomMatrix(sizes[layer + 1], 1);
+
+        matrix_t unfused;
+        double unfusedTime = microseconds([&]() {
+            matrix_t summation = matrix_t::matrixMultiplyAdd(weights, input, biases);
+            unfused = matrix_t::map(summation, [](T x) { return 1 / (1 + std::exp(-x)); });
+        }, iterations);
+
+        matrix_t fused;
+        double fusedTime = microseconds([&]() {
+            matrix_t::matrixMultiplyAddSigmoid(weights, input, biases, fused);
+        }, iterations);
+
+        T difference = 0;
+        for (int i = 0; i < fused.getRows(); i++) {
+            difference = std::max(difference, std::abs(fused(i, 0) - unfused(i, 0)));
+        }
+
+        std::string shape = std::to_string(sizes[layer]) + " -> " + std::to_string(sizes[layer + 1]);
+        std::cout << std::setw(14) << shape << std::setw(14) << unfusedTime << std::setw(12) << fusedTime << std::setw(9) << unfusedTime / fusedTime
+            << "x" << std::setw(16) << std::scientific << difference << std::fixed << std::endl;
+
+        unfusedTotal += unfusedTime;
+        fusedTotal += fusedTime;
+        input = fused;
+    }
+
+    std::cout << std::setw(14) << "Network" << std::setw(14) << unfusedTotal << std::setw(12) << fusedTotal << std::setw(9) << unfusedTotal / fusedTotal
+        << "x" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000;
+    std::vector<int> sizes{ 784, 392, 196, 98, 49, 25, 10 };
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "GEMM kernel: " << gemm::kernelName() << ". Activation kernel: " << activation::kernelName() << "." << std::endl;
+    compareLayers<double>("double", sizes, iterations);
+    compareLayers<float>("float", sizes, iterations);
+}
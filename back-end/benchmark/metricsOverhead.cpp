@@ -0,0 +1,68 @@
+#include <metrics.cpp>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPU time of the calling thread.
+double cpuNanoseconds() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+// Measures what the metrics of one /predict request cost: the counters and the stage histograms a request records, and the
+// timestamps taken around them, on several threads at once. A request records receive, parse, queue, write, and total,
+// and its share of a batch records every layer, counted here as if every request ran alone.
+int main(int argc, char** argv) {
+    int requests = argc > 1 ? std::stoi(argv[1]) : 1000000;
+    int threads = argc > 2 ? std::stoi(argv[2]) : 4;
+    const int layers = 6;
+
+    // Every thread measures the CPU time of its own requests, which neither shrinks when the threads run in parallel nor grows
+    // when they take turns on fewer cores.
+    std::vector<double> threadNanoseconds(threads);
+    auto recordRequests = [&](int thread) {
+        double threadStart = cpuNanoseconds();
+        metrics& m = metrics::getInstance();
+        std::vector<long> layerNanoseconds(layers);
+        for (int i = 0; i < requests; i++) {
+            auto arrival = std::chrono::steady_clock::now();
+            m.count(metrics::predictRequests);
+            m.count(metrics::started);
+            m.record(metrics::receive, std::chrono::steady_clock::now() - arrival);
+            m.record(metrics::parse, std::chrono::steady_clock::now() - arrival);
+            m.record(metrics::queue, std::chrono::steady_clock::now() - arrival);
+            for (int l = 0; l < layers; l++) layerNanoseconds[l] = 1000 + 37 * i % 5000;
+            m.recordLayers(layerNanoseconds);
+            auto end = std::chrono::steady_clock::now();
+            m.record(metrics::write, end - arrival);
+            m.record(metrics::total, end - arrival);
+            m.count(metrics::finished);
+        }
+        threadNanoseconds[thread] = cpuNanoseconds() - threadStart;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) workers.push_back(std::thread(recordRequests, t));
+    for (std::thread& worker : workers) worker.join();
+
+    double slowest = 0.0, total = 0.0;
+    for (double time : threadNanoseconds) {
+        slowest = std::max(slowest, time);
+        total += time;
+    }
+
+    auto scrapeStart = std::chrono::steady_clock::now();
+    std::string scrape = metrics::getInstance().prometheus();
+    std::chrono::duration<double, std::micro> scrapeTime = std::chrono::steady_clock::now() - scrapeStart;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Recording on " << threads << " threads: " << total / threads / requests << " ns of CPU time per request on average, "
+        << slowest / requests << " ns on the slowest thread." << std::endl;
+    std::cout << "Scrape of " << scrape.size() << " bytes: " << scrapeTime.count() << " us." << std::endl;
+}
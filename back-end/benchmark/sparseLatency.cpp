@@ -0,0 +1,112 @@
+#include <matrix.h>
+#include <sparseMatrix.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Returns the mean time of a call to f in microseconds, after a few warm up calls.
+template <typename F>
+double microseconds(F f, int iterations) {
+    for (int i = 0; i < 10; i++) f();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) f();
+    std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+    return time.count() / iterations;
+}
+
+// Compares the first layer of the served network, 784 inputs to 392 neurons, with inputs of growing density. The forward
+// product goes through matrix::matrixMultiplyAdd and through sparseMatrix::multiplyAdd, the compression included, and the
+// weight update of a training step through a dense gradient and through sparseMatrix::subtractOuterProducts. The density at
+// which the first Speedup column of the batch of 1 drops below 1x is MLP::sparseProductDensity, and where the second one does
+// is MLP::sparseUpdateDensity, both in model/multilayerPerceptron.cpp with a value for float and one for double.
+template <typename T>
+void compare(const std::string& name, int batchSize, int iterations) {
+    typedef basicMatrix<T> matrix_t;
+
+    std::default_random_engine re(0);
+    std::uniform_real_distribution<T> unif(-1, 1);
+    auto randomMatrix = [&](int rows, int columns) {
+        std::vector<T> data(rows * columns);
+        for (T& value : data) value = unif(re);
+        return matrix_t(data, rows, columns);
+    };
+
+    matrix_t weights = randomMatrix(392, 784);
+    matrix_t biases = randomMatrix(392, 1);
+    matrix_t partialDerivatives = randomMatrix(392, batchSize);
+    T rate = 0.01;
+
+    std::cout << name << ", batch of " << batchSize << std::endl;
+    std::cout << std::setw(10) << "Density" << std::setw(14) << "Dense (us)" << std::setw(14) << "Sparse (us)" << std::setw(10) << "Speedup"
+        << std::setw(20) << "Dense update (us)" << std::setw(20) << "Sparse update (us)" << std::setw(10) << "Speedup" << std::setw(16) << "Max difference" << std::endl;
+
+    for (double density : { 0.05, 0.1, 0.2, 0.3, 0.4, 0.5 }) {
+        // Strokes of a pen two pixels wide across the middle of a 28 x 28 canvas, until the digit has the density asked for.
+        // The non-zero pixels are clustered along the rows of the canvas like those of a drawn digit.
+        std::uniform_real_distribution<double> pick(0, 1);
+        std::vector<T> inputData(784 * batchSize, 0);
+        for (int j = 0; j < batchSize; j++) {
+            int set = 0;
+            while (set < density * 784) {
+                double x = 4 + 20 * pick(re), y = 4 + 20 * pick(re);
+                double dx = pick(re) - 0.5, dy = pick(re) - 0.5;
+                for (int step = 0; step < 20 && set < density * 784; step++, x += dx, y += dy) {
+                    for (int px = (int)x; px < (int)x + 2; px++) {
+                        for (int py = (int)y; py < (int)y + 2; py++) {
+                            if (px < 0 || px >= 28 || py < 0 || py >= 28) continue;
+                            T& value = inputData[(28 * py + px) * batchSize + j];
+                            if (value == 0) set++;
+                            value = 0.5 + pick(re) / 2;
+                        }
+                    }
+                }
+            }
+        }
+        matrix_t inputs = matrix_t(inputData, 784, batchSize);
+
+        matrix_t dense, sparse;
+        sparseMatrix<T> sparseInputs;
+        double denseTime = microseconds([&]() { matrix_t::matrixMultiplyAdd(weights, inputs, biases, dense); }, iterations);
+        double sparseTime = microseconds([&]() {
+            sparseInputs.compress(inputs, 1.0);
+            sparseInputs.multiplyAdd(weights, biases, sparse);
+        }, iterations);
+
+        double maxDifference = 0.0;
+        for (int i = 0; i < 392; i++) {
+            for (int j = 0; j < batchSize; j++) maxDifference = std::max(maxDifference, (double)std::abs(dense(i, j) - sparse(i, j)));
+        }
+
+        matrix_t denseWeights = weights, sparseWeights = weights, gradient;
+        double denseUpdateTime = microseconds([&]() {
+            matrix_t::matrixMultiply(partialDerivatives, matrix_t::transposeView(inputs), gradient);
+            denseWeights = denseWeights - matrix_t::scalarMultiply(gradient, rate);
+        }, iterations);
+        double sparseUpdateTime = microseconds([&]() { sparseInputs.subtractOuterProducts(sparseWeights, partialDerivatives, rate); }, iterations);
+
+        for (int i = 0; i < 392; i++) {
+            for (int j = 0; j < 784; j++) maxDifference = std::max(maxDifference, (double)std::abs(denseWeights(i, j) - sparseWeights(i, j)));
+        }
+
+        std::cout << std::setw(10) << density << std::setw(14) << denseTime << std::setw(14) << sparseTime << std::setw(9) << denseTime / sparseTime << "x"
+            << std::setw(20) << denseUpdateTime << std::setw(20) << sparseUpdateTime << std::setw(9) << denseUpdateTime / sparseUpdateTime << "x"
+            << std::setw(16) << std::scientific << maxDifference << std::fixed << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 1000;
+
+    std::cout << std::fixed << std::setprecision(2);
+    compare<double>("double", 1, iterations);
+    compare<float>("float", 1, iterations);
+    compare<double>("double", 32, iterations / 10);
+    compare<float>("float", 32, iterations / 10);
+}
@@ -0,0 +1,75 @@
+#include <multilayerPerceptron.cpp>
+#include <staticMultilayerPerceptron.cpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Returns the mean time of a call to f in microseconds, after a few warm up calls. The iterations are split into
+// five rounds and the fastest round counts, which keeps other load on the machine out of the comparison.
+template <typename F>
+double microseconds(F f, int iterations) {
+    for (int i = 0; i < 10; i++) f();
+
+    double fastest = 0.0;
+    for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations / 5; i++) f();
+        std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+        double mean = time.count() / (iterations / 5);
+        if (round == 0 || mean < fastest) fastest = mean;
+    }
+    return fastest;
+}
+
+// Compares the latency of a single prediction through the runtime MLP (MLP::classify) and through the StaticMLP of the
+// same weights, and how far their outputs are apart.
+template <typename T, typename S>
+void compare(const std::string& name, const MLP<T>& model, const S& staticModel, const basicMatrix<T>& inputs, int iterations) {
+    typename MLP<T>::inferenceBuffers buffers = model.createInferenceBuffers();
+    basicMatrixView<T> input = basicMatrix<T>::transposeView(basicMatrix<T>::getRowView(inputs, 0));
+
+    double maxDifference = 0.0;
+    int disagreements = 0;
+    for (int i = 0; i < inputs.getRows(); i++) {
+        basicMatrixView<T> column = basicMatrix<T>::transposeView(basicMatrix<T>::getRowView(inputs, i));
+        const basicMatrix<T>& outputs = model.infer(column, buffers);
+        auto staticOutputs = staticModel.infer(column);
+        for (int j = 0; j < outputs.getRows(); j++) {
+            maxDifference = std::max(maxDifference, (double)std::abs(outputs(j, 0) - staticOutputs[j]));
+        }
+        if (model.classify(column, buffers).label != staticModel.classify(column).label) disagreements++;
+    }
+
+    double runtimeTime = microseconds([&]() { model.classify(input, buffers); }, iterations);
+    double staticTime = microseconds([&]() { staticModel.classify(input); }, iterations);
+
+    std::cout << name << ": MLP " << runtimeTime << " us, StaticMLP " << staticTime << " us, speedup " << runtimeTime / staticTime << "x" << std::endl;
+    std::cout << "    Max output difference: " << std::scientific << maxDifference << std::fixed << ". Predictions that differ: " << disagreements << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000;
+
+    std::default_random_engine re(0);
+    std::uniform_real_distribution<double> unif(0, 1);
+    doubleArray_t inputData(100 * 784);
+    for (double& value : inputData) value = unif(re);
+    matrix inputs = matrix(inputData, 100, 784);
+
+    // Random weights, the latency does not depend on their values.
+    MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 25});
+    auto [inputWeights, hiddenWeights] = model.getWeights();
+    std::vector<matrix> hiddenBiases = std::get<1>(model.getBiases());
+    matrix outputBiases = matrix(doubleArray_t(10, 0.1), 10, 1);
+    model.setBiases(outputBiases, hiddenBiases);
+
+    StaticMLP<784, 392, 196, 98, 49, 25, 10> staticModel(inputWeights, outputBiases, hiddenWeights, hiddenBiases);
+    floatStaticMLP<784, 392, 196, 98, 49, 25, 10> floatStaticModel(inputWeights, outputBiases, hiddenWeights, hiddenBiases);
+    MLP<float> floatModel = MLP<float>(model);
+
+    std::cout << std::fixed << std::setprecision(3);
+    compare("double", model, staticModel, inputs, iterations);
+    compare("float", floatModel, floatStaticModel, floatMatrix(inputs), iterations);
+}
@@ -0,0 +1,82 @@
+#include <multilayerPerceptron.cpp>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+
+// Every allocation in the process goes through the operators below, which count them while counting is on.
+namespace {
+    std::atomic<bool> counting(false);
+    std::atomic<long> allocations(0);
+}
+
+void* operator new(std::size_t size) {
+    if (counting) allocations++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Returns the number of allocations made while running f.
+template <typename F>
+long countAllocations(F f) {
+    allocations = 0;
+    counting = true;
+    f();
+    counting = false;
+    return allocations;
+}
+
+// Checks that training on a batch does not allocate once its workspace exists, for full batches, a smaller final
+// batch, a batch of one, and a batch of one sparse example, which takes the sparse first layer of MLP::backpropagate. Exits with a non-zero status when any batch allocates.
+int main() {
+    const int examples = 256;
+    const int batchSize = 32;
+    const int iterations = 20;
+
+    std::default_random_engine re(0);
+    std::uniform_real_distribution<double> unif(0, 1);
+    doubleArray_t inputData(examples * 784), sparseData(examples * 784), labelData(examples * 10);
+    for (int i = 0; i < examples; i++) {
+        labelData[i * 10 + i % 10] = 1;
+        for (int j = 0; j < 784; j++) {
+            inputData[i * 784 + j] = unif(re);
+            // About as many pixels as a drawn digit has set.
+            if (unif(re) < 0.15) sparseData[i * 784 + j] = unif(re);
+        }
+    }
+    matrix inputs = matrix(inputData, examples, 784);
+    matrix sparseInputs = matrix(sparseData, examples, 784);
+    matrix labels = matrix(labelData, examples, 10);
+
+    MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 25});
+    MLP<>::workspace ws = model.createWorkspace(batchSize);
+
+    // The first batch grows the per thread buffers of the matrix library, see gemm.cpp.
+    model.trainBatch(inputs, labels, 0, batchSize, ws, 0.01);
+    model.trainBatch(inputs, labels, 0, 1, ws, 0.01);
+    model.trainBatch(sparseInputs, labels, 0, 1, ws, 0.01);
+
+    bool failed = false;
+    for (auto [data, rows] : { std::pair<const matrix*, int>(&inputs, batchSize), { &inputs, batchSize / 2 + 1 }, { &inputs, 1 }, { &sparseInputs, 1 } }) {
+        long count = countAllocations([&]() {
+            for (int i = 0; i < iterations; i++) {
+                model.trainBatch(*data, labels, (i * batchSize) % examples, rows, ws, 0.01);
+            }
+        });
+        std::cout << (data == &sparseInputs ? "Sparse batch" : "Batch") << " size " << rows << ": " << count << " allocations in " << iterations << " batches." << std::endl;
+        if (count != 0) failed = true;
+    }
+
+    std::cout << (failed ? "FAILED: training allocated." : "OK: training does not allocate.") << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+#include <multilayerPerceptron.cpp>
+#include <modelIO.cpp>
+#include <csvParser.cpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// Returns the index of the largest output.
+template <typename T>
+int argmax(const basicMatrix<T>& output) {
+    int index = 0;
+    for (int i = 1; i < output.getRows(); i++) {
+        if (output(i, 0) > output(index, 0)) index = i;
+    }
+    return index;
+}
+
+// Runs every test example through the model and reports its accuracy and time per prediction. When reference
+// outputs are given, also reports how far the outputs drift from them and how many predictions differ.
+// Returns the outputs, one row per example.
+template <typename T>
+matrix evaluate(const std::string& name, MLP<T>& model, const basicMatrix<T>& inputs, const matrix& labels, const matrix* reference) {
+    int examples = inputs.getRows();
+    int outputs = labels.getColumns();
+    doubleArray_t outputData(examples * outputs);
+
+    int correct = 0;
+    int disagreements = 0;
+    double maxDrift = 0.0;
+    double totalDrift = 0.0;
+    std::chrono::duration<double, std::micro> time(0);
+    typename MLP<T>::inferenceBuffers buffers = model.createInferenceBuffers();
+
+    for (int i = 0; i < examples; i++) {
+        int label = argmax(matrix(matrix::transposeView(matrix::getRowView(labels, i))));
+
+        auto start = std::chrono::steady_clock::now();
+        const basicMatrix<T>& output = model.infer(basicMatrix<T>::transposeView(basicMatrix<T>::getRowView(inputs, i)), buffers);
+        time += std::chrono::steady_clock::now() - start;
+
+        int prediction = argmax(output);
+        if (prediction == label) correct++;
+
+        for (int j = 0; j < outputs; j++) {
+            outputData[outputs * i + j] = output(j, 0);
+        }
+
+        if (reference == nullptr) continue;
+
+        int referencePrediction = 0;
+        for (int j = 0; j < outputs; j++) {
+            double drift = std::abs((double)output(j, 0) - (*reference)(i, j));
+            maxDrift = std::max(maxDrift, drift);
+            totalDrift += drift;
+            if ((*reference)(i, j) > (*reference)(i, referencePrediction)) referencePrediction = j;
+        }
+        if (prediction != referencePrediction) disagreements++;
+    }
+
+    std::cout << name << " accuracy: " << (double)correct / examples * 100 << "%, " << time.count() / examples << " us per prediction" << std::endl;
+    if (reference != nullptr) {
+        std::cout << "    Max output drift: " << maxDrift << ". Mean output drift: " << totalDrift / ((double)examples * outputs) << "." << std::endl;
+        std::cout << "    Predictions that differ from double: " << disagreements << std::endl;
+    }
+
+    return matrix(std::move(outputData), examples, outputs);
+}
+
+// Loads the served weights and compares the double model with its float and int8 versions on the MNIST test
+// set. The int8 models use weights quantized with one scale per row, see quantizedMatrix.h.
+int main() {
+    auto [testInputs, testLabels] = csv::read_data("../../train/mnist_test.csv", 10);
+    testInputs = matrix::scalarMultiply(testInputs, 1.0 / 255.0);
+    floatMatrix floatTestInputs = floatMatrix(testInputs);
+
+    MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 25});
+    auto [inputWeights, outputBiases, hiddenLayersWeights, hiddenLayersBiases] = readFromFile("../../weights/784-392-196-98-49-25-10.txt");
+    model.setWeights(inputWeights, hiddenLayersWeights);
+    model.setBiases(outputBiases, hiddenLayersBiases);
+
+    MLP<float> floatModel = MLP<float>(model);
+
+    std::cout << "Examples: " << testInputs.getRows() << ". Int8 kernel: " << quantizedMatrix::kernelName() << "." << std::endl;
+    std::cout << "Baseline from MLP::test, ";
+    model.test(testInputs, testLabels);
+
+    matrix reference = evaluate("double", model, testInputs, testLabels, nullptr);
+    evaluate("float", floatModel, floatTestInputs, testLabels, &reference);
+
+    model.quantize();
+    floatModel.quantize();
+    evaluate("int8 (double activations)", model, testInputs, testLabels, &reference);
+    evaluate("int8 (float activations)", floatModel, floatTestInputs, testLabels, &reference);
+
+    std::cout << "Quantized MLP::test, ";
+    model.test(testInputs, testLabels);
+}
@@ -0,0 +1,234 @@
+#include "activation.h"
+#include "avx2Vector.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Constants of the exp approximation. Inputs are clamped to [-limit, limit] so 2^n stays a normal number,
+    // ln(2) is split into a high and a low part so n * ln(2) is subtracted without losing bits, and degree is
+    // the number of Taylor terms needed for exp(r) to reach the precision of the type.
+    template <typename T>
+    struct expConstants;
+
+    template <>
+    struct expConstants<double> {
+        static constexpr double limit = 708.0;
+        static constexpr double ln2High = 6.93147180369123816490e-01;
+        static constexpr double ln2Low = 1.90821492927058770002e-10;
+        static const int degree = 12;
+    };
+
+    template <>
+    struct expConstants<float> {
+        static constexpr float limit = 87.0f;
+        static constexpr float ln2High = 0.693359375f;
+        static constexpr float ln2Low = -2.12194440e-4f;
+        static const int degree = 7;
+    };
+
+    bool hasAvx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+
+    const bool useAvx2 = hasAvx2();
+
+    template <typename T>
+    void scalarSigmoid(const T* in, T* out, long n) {
+        for (long i = 0; i < n; i++) {
+            out[i] = 1 / (1 + std::exp(-in[i]));
+        }
+    }
+
+    template <typename T>
+    void scalarOneMinus(const T* in, T* out, long n) {
+        for (long i = 0; i < n; i++) {
+            out[i] = 1 - in[i];
+        }
+    }
+
+    template <typename T>
+    void scalarSquare(const T* in, T* out, long n) {
+        for (long i = 0; i < n; i++) {
+            out[i] = in[i] * in[i];
+        }
+    }
+
+    template <typename T>
+    double scalarSumOfSquares(const T* in, long n) {
+        double sum = 0.0;
+        for (long i = 0; i < n; i++) {
+            sum += (double)in[i] * in[i];
+        }
+        return sum;
+    }
+
+    // exp(x) = 2^n * exp(r) with n = round(x / ln(2)), exp(r) is evaluated with Horner's rule from the Taylor
+    // coefficients 1 / k!.
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    typename avx2Vector<T>::type avx2Exp(typename avx2Vector<T>::type x, const typename avx2Vector<T>::type* coefficients) {
+        typedef avx2Vector<T> V;
+        typedef expConstants<T> E;
+
+        x = V::min(V::max(x, V::set(-E::limit)), V::set(E::limit));
+        typename V::type n = V::round(V::mul(x, V::set((T)1.44269504088896340736)));
+        typename V::type r = V::fnmadd(n, V::set(E::ln2High), x);
+        r = V::fnmadd(n, V::set(E::ln2Low), r);
+
+        typename V::type p = coefficients[E::degree];
+        for (int k = E::degree - 1; k >= 0; k--) {
+            p = V::fmadd(p, r, coefficients[k]);
+        }
+        return V::mul(p, V::pow2(n));
+    }
+
+    // The tail that does not fill a vector goes through a zero padded copy, so every element gets the same
+    // approximation.
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2Sigmoid(const T* in, T* out, long n) {
+        typedef avx2Vector<T> V;
+        typedef expConstants<T> E;
+        const int W = V::width;
+
+        typename V::type coefficients[E::degree + 1];
+        T coefficient = 1;
+        for (int k = 0; k <= E::degree; k++) {
+            coefficients[k] = V::set(coefficient);
+            coefficient /= k + 1;
+        }
+
+        const typename V::type ones = V::set(1);
+        const typename V::type zeros = V::zero();
+        long i = 0;
+        for (; i + W <= n; i += W) {
+            typename V::type e = avx2Exp<T>(V::sub(zeros, V::load(in + i)), coefficients);
+            V::store(out + i, V::div(ones, V::add(ones, e)));
+        }
+
+        if (i < n) {
+            T tail[W] = {};
+            std::copy(in + i, in + n, tail);
+            typename V::type e = avx2Exp<T>(V::sub(zeros, V::load(tail)), coefficients);
+            V::store(tail, V::div(ones, V::add(ones, e)));
+            std::copy(tail, tail + (n - i), out + i);
+        }
+    }
+
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2OneMinus(const T* in, T* out, long n) {
+        typedef avx2Vector<T> V;
+        const typename V::type ones = V::set(1);
+        long i = 0;
+        for (; i + V::width <= n; i += V::width) {
+            V::store(out + i, V::sub(ones, V::load(in + i)));
+        }
+        for (; i < n; i++) {
+            out[i] = 1 - in[i];
+        }
+    }
+
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2Square(const T* in, T* out, long n) {
+        typedef avx2Vector<T> V;
+        long i = 0;
+        for (; i + V::width <= n; i += V::width) {
+            typename V::type x = V::load(in + i);
+            V::store(out + i, V::mul(x, x));
+        }
+        for (; i < n; i++) {
+            out[i] = in[i] * in[i];
+        }
+    }
+
+    // Four accumulators hide the latency of the FMAs. Floats are widened to double four at a time, so the
+    // sum of a large float matrix does not lose precision.
+    __attribute__((target("avx2,fma")))
+    double avx2SumOfSquares(const double* in, long n) {
+        typedef avx2Vector<double> V;
+        typename V::type sums[4] = { V::zero(), V::zero(), V::zero(), V::zero() };
+        long i = 0;
+        for (; i + 4 * V::width <= n; i += 4 * V::width) {
+#pragma GCC unroll 4
+            for (int s = 0; s < 4; s++) {
+                typename V::type x = V::load(in + i + s * V::width);
+                sums[s] = V::fmadd(x, x, sums[s]);
+            }
+        }
+        double sum = V::sum(V::add(V::add(sums[0], sums[1]), V::add(sums[2], sums[3])));
+        for (; i < n; i++) {
+            sum += in[i] * in[i];
+        }
+        return sum;
+    }
+
+    __attribute__((target("avx2,fma")))
+    double avx2SumOfSquares(const float* in, long n) {
+        typedef avx2Vector<double> V;
+        typename V::type sums[4] = { V::zero(), V::zero(), V::zero(), V::zero() };
+        long i = 0;
+        for (; i + 16 <= n; i += 16) {
+#pragma GCC unroll 4
+            for (int s = 0; s < 4; s++) {
+                typename V::type x = _mm256_cvtps_pd(_mm_loadu_ps(in + i + s * 4));
+                sums[s] = V::fmadd(x, x, sums[s]);
+            }
+        }
+        double sum = V::sum(V::add(V::add(sums[0], sums[1]), V::add(sums[2], sums[3])));
+        for (; i < n; i++) {
+            sum += (double)in[i] * in[i];
+        }
+        return sum;
+    }
+}
+
+namespace activation {
+    void sigmoid(const double* in, double* out, long n) {
+        if (useAvx2) avx2Sigmoid<double>(in, out, n);
+        else scalarSigmoid<double>(in, out, n);
+    }
+
+    void sigmoid(const float* in, float* out, long n) {
+        if (useAvx2) avx2Sigmoid<float>(in, out, n);
+        else scalarSigmoid<float>(in, out, n);
+    }
+
+    void oneMinus(const double* in, double* out, long n) {
+        if (useAvx2) avx2OneMinus<double>(in, out, n);
+        else scalarOneMinus<double>(in, out, n);
+    }
+
+    void oneMinus(const float* in, float* out, long n) {
+        if (useAvx2) avx2OneMinus<float>(in, out, n);
+        else scalarOneMinus<float>(in, out, n);
+    }
+
+    void square(const double* in, double* out, long n) {
+        if (useAvx2) avx2Square<double>(in, out, n);
+        else scalarSquare<double>(in, out, n);
+    }
+
+    void square(const float* in, float* out, long n) {
+        if (useAvx2) avx2Square<float>(in, out, n);
+        else scalarSquare<float>(in, out, n);
+    }
+
+    double sumOfSquares(const double* in, long n) {
+        return useAvx2 ? avx2SumOfSquares(in, n) : scalarSumOfSquares(in, n);
+    }
+
+    double sumOfSquares(const float* in, long n) {
+        return useAvx2 ? avx2SumOfSquares(in, n) : scalarSumOfSquares(in, n);
+    }
+
+    bool avx2Supported() {
+        return useAvx2;
+    }
+
+    const char* kernelName() {
+        return useAvx2 ? "avx2-fma" : "scalar";
+    }
+}
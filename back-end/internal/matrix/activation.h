@@ -0,0 +1,82 @@
+#ifndef LIBACTIVATION_H
+#define LIBACTIVATION_H
+
+#include <cmath>
+
+// Activation functions applied to contiguous arrays of double or float. The AVX2 kernels evaluate exp with
+// a polynomial after range reduction, exp(x) = 2^n * exp(r) with |r| <= ln(2) / 2, to about one unit in the
+// last place of the element type. The kernel is picked at runtime from the CPU features.
+namespace activation {
+    // Computes out[i] = 1 / (1 + exp(-in[i])) for n elements. in and out may be the same array.
+    void sigmoid(const double* in, double* out, long n);
+
+    void sigmoid(const float* in, float* out, long n);
+
+    // Computes out[i] = 1 - in[i], the derivative of the sigmoid is s * (1 - s).
+    void oneMinus(const double* in, double* out, long n);
+
+    void oneMinus(const float* in, float* out, long n);
+
+    // Computes out[i] = in[i] * in[i].
+    void square(const double* in, double* out, long n);
+
+    void square(const float* in, float* out, long n);
+
+    // Returns the sum of in[i] * in[i], accumulated in double.
+    double sumOfSquares(const double* in, long n);
+
+    double sumOfSquares(const float* in, long n);
+
+    // Whether the CPU supports AVX2 and FMA, which the kernels of the matrix library select on.
+    bool avx2Supported();
+
+    // Returns the name of the kernels selected for this CPU.
+    const char* kernelName();
+
+    // Function objects for the activations above, for use with matrix::map and matrix::mapSum. Inside an
+    // expression they are inlined like any other callable, while mapping a whole matrix with one of them
+    // runs the array kernel instead, see arrayKernel below.
+    struct sigmoidFunction {
+        template <typename T>
+        T operator()(T x) const { return 1 / (1 + std::exp(-x)); }
+    };
+
+    struct oneMinusFunction {
+        template <typename T>
+        T operator()(T x) const { return 1 - x; }
+    };
+
+    struct squareFunction {
+        template <typename T>
+        T operator()(T x) const { return x * x; }
+    };
+
+    // Maps a function object to its array kernel. exists is false for any other callable.
+    template <typename F>
+    struct arrayKernel {
+        static const bool exists = false;
+    };
+
+    template <>
+    struct arrayKernel<sigmoidFunction> {
+        static const bool exists = true;
+        template <typename T>
+        static void apply(const T* in, T* out, long n) { sigmoid(in, out, n); }
+    };
+
+    template <>
+    struct arrayKernel<oneMinusFunction> {
+        static const bool exists = true;
+        template <typename T>
+        static void apply(const T* in, T* out, long n) { oneMinus(in, out, n); }
+    };
+
+    template <>
+    struct arrayKernel<squareFunction> {
+        static const bool exists = true;
+        template <typename T>
+        static void apply(const T* in, T* out, long n) { square(in, out, n); }
+    };
+}
+
+#endif
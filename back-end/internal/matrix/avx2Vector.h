@@ -0,0 +1,76 @@
+#ifndef LIBAVX2VECTOR_H
+#define LIBAVX2VECTOR_H
+
+#include <immintrin.h>
+
+// Thin wrappers over the AVX2 intrinsics so the kernels of the matrix library can be written once for both
+// element types. Every function is compiled for AVX2 and FMA regardless of the build flags, callers must check
+// the CPU at runtime before using them.
+template <typename T>
+struct avx2Vector;
+
+template <>
+struct avx2Vector<double> {
+    typedef __m256d type;
+    static const int width = 4;
+
+    __attribute__((target("avx2,fma"))) static type zero() { return _mm256_setzero_pd(); }
+    __attribute__((target("avx2,fma"))) static type set(double value) { return _mm256_set1_pd(value); }
+    __attribute__((target("avx2,fma"))) static type broadcast(const double* value) { return _mm256_broadcast_sd(value); }
+    __attribute__((target("avx2,fma"))) static type load(const double* data) { return _mm256_loadu_pd(data); }
+    __attribute__((target("avx2,fma"))) static void store(double* data, type value) { _mm256_storeu_pd(data, value); }
+    __attribute__((target("avx2,fma"))) static type add(type a, type b) { return _mm256_add_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type div(type a, type b) { return _mm256_div_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type min(type a, type b) { return _mm256_min_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type max(type a, type b) { return _mm256_max_pd(a, b); }
+    __attribute__((target("avx2,fma"))) static type fmadd(type a, type b, type c) { return _mm256_fmadd_pd(a, b, c); }
+    __attribute__((target("avx2,fma"))) static type fnmadd(type a, type b, type c) { return _mm256_fnmadd_pd(a, b, c); }
+    __attribute__((target("avx2,fma"))) static type round(type a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+    // Returns 2^n for integral n within the exponent range, by writing n straight into the exponent bits.
+    __attribute__((target("avx2,fma"))) static type pow2(type n) {
+        __m256i exponent = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(exponent, _mm256_set1_epi64x(1023)), 52));
+    }
+
+    __attribute__((target("avx2,fma"))) static double sum(type v) {
+        __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+};
+
+template <>
+struct avx2Vector<float> {
+    typedef __m256 type;
+    static const int width = 8;
+
+    __attribute__((target("avx2,fma"))) static type zero() { return _mm256_setzero_ps(); }
+    __attribute__((target("avx2,fma"))) static type set(float value) { return _mm256_set1_ps(value); }
+    __attribute__((target("avx2,fma"))) static type broadcast(const float* value) { return _mm256_broadcast_ss(value); }
+    __attribute__((target("avx2,fma"))) static type load(const float* data) { return _mm256_loadu_ps(data); }
+    __attribute__((target("avx2,fma"))) static void store(float* data, type value) { _mm256_storeu_ps(data, value); }
+    __attribute__((target("avx2,fma"))) static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type div(type a, type b) { return _mm256_div_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type min(type a, type b) { return _mm256_min_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type max(type a, type b) { return _mm256_max_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static type fmadd(type a, type b, type c) { return _mm256_fmadd_ps(a, b, c); }
+    __attribute__((target("avx2,fma"))) static type fnmadd(type a, type b, type c) { return _mm256_fnmadd_ps(a, b, c); }
+    __attribute__((target("avx2,fma"))) static type round(type a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+    __attribute__((target("avx2,fma"))) static type pow2(type n) {
+        __m256i exponent = _mm256_cvtps_epi32(n);
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(exponent, _mm256_set1_epi32(127)), 23));
+    }
+
+    __attribute__((target("avx2,fma"))) static float sum(type v) {
+        __m128 quad = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        __m128 pair = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+        return _mm_cvtss_f32(_mm_add_ss(pair, _mm_movehdup_ps(pair)));
+    }
+};
+
+#endif
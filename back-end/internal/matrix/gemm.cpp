@@ -0,0 +1,610 @@
+#include "gemm.h"
+#include "activation.h"
+#include "avx2Vector.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <immintrin.h>
+
+// This is a BLIS style GEMM. The operands are split into blocks that fit in the caches, and each block is
+// packed into a contiguous buffer in the exact order the microkernel reads it:
+//
+//   jc loop: NC columns of B and C                      (B panel lives in L3)
+//     pc loop: KC of the shared dimension, pack B       (KC x NR sliver of B lives in L1)
+//       ic loop: MC rows of A and C, pack A             (MC x KC block of A lives in L2)
+//         jr loop: NR columns, ir loop: MR rows          (microkernel keeps the MR x NR tile of C in registers)
+//
+// Everything is written once for both element types, the block sizes and the SIMD width come from the
+// traits below. The block sizes match a Haswell-like core with 32 KB of L1 and 256 KB of L2 per core.
+namespace {
+    template <typename T>
+    struct blocking;
+
+    template <>
+    struct blocking<double> {
+        static const int MR = 6;
+        static const int NR = 8;
+        static const int KC = 256;
+        static const int MC = 72;
+        static const int NC = 4080;
+    };
+
+    // Floats are half the size, so a row of the register tile holds twice as many of them.
+    template <>
+    struct blocking<float> {
+        static const int MR = 6;
+        static const int NR = 16;
+        static const int KC = 256;
+        static const int MC = 144;
+        static const int NC = 4080;
+    };
+
+    // Products smaller than this many multiply-adds skip packing, which would cost more than it saves.
+    const long packingThreshold = 8 * 8 * 8;
+
+    // Products with at least this many multiply-adds are split across the thread pool.
+    const long parallelThreshold = 1 << 15;
+
+    // Matrix-vector products with at least this many multiply-adds split their rows across the thread pool.
+    // The product is bound by memory bandwidth, so it needs more work than a GEMM before threads pay off.
+    const long vectorParallelThreshold = 1 << 16;
+
+    bool hasAvx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+
+    const bool useAvx2 = hasAvx2();
+
+    // Portable microkernel, computes an MR x NR tile of C = alpha * A * B + beta * C from packed slivers of
+    // A and B. The accumulator tile is small enough for the compiler to keep it in registers.
+    template <typename T>
+    void scalarKernel(int k, const T* a, const T* b, T alpha, T beta, T* c, long rowStrideC) {
+        const int MR = blocking<T>::MR;
+        const int NR = blocking<T>::NR;
+        T tile[MR][NR] = {};
+
+        for (int p = 0; p < k; p++) {
+            for (int i = 0; i < MR; i++) {
+                for (int j = 0; j < NR; j++) {
+                    tile[i][j] += a[i] * b[j];
+                }
+            }
+            a += MR;
+            b += NR;
+        }
+
+        for (int i = 0; i < MR; i++) {
+            for (int j = 0; j < NR; j++) {
+                T value = alpha * tile[i][j];
+                c[rowStrideC * i + j] = beta == 0 ? value : value + beta * c[rowStrideC * i + j];
+            }
+        }
+    }
+
+    // AVX2 + FMA microkernel. Every row of the tile is two vectors, so the 6 row tile takes 12 of the 16 ymm
+    // registers, leaving room for the two vectors of B and the broadcast element of A.
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2Kernel(int k, const T* a, const T* b, T alpha, T beta, T* c, long rowStrideC) {
+        typedef avx2Vector<T> V;
+        const int MR = blocking<T>::MR;
+        const int NR = blocking<T>::NR;
+        typename V::type left[MR], right[MR];
+
+#pragma GCC unroll 6
+        for (int i = 0; i < MR; i++) {
+            left[i] = V::zero();
+            right[i] = V::zero();
+        }
+
+        for (int p = 0; p < k; p++) {
+            typename V::type b0 = V::load(b);
+            typename V::type b1 = V::load(b + V::width);
+#pragma GCC unroll 6
+            for (int i = 0; i < MR; i++) {
+                typename V::type ai = V::broadcast(a + i);
+                left[i] = V::fmadd(ai, b0, left[i]);
+                right[i] = V::fmadd(ai, b1, right[i]);
+            }
+            a += MR;
+            b += NR;
+        }
+
+        typename V::type alphas = V::set(alpha);
+        typename V::type betas = V::set(beta);
+#pragma GCC unroll 6
+        for (int i = 0; i < MR; i++) {
+            T* row = c + rowStrideC * i;
+            typename V::type l = V::mul(alphas, left[i]);
+            typename V::type r = V::mul(alphas, right[i]);
+            if (beta != 0) {
+                l = V::fmadd(betas, V::load(row), l);
+                r = V::fmadd(betas, V::load(row + V::width), r);
+            }
+            V::store(row, l);
+            V::store(row + V::width, r);
+        }
+    }
+
+    // Number of multiply calls in progress on this thread. A thread waiting in parallelFor helps run other
+    // tasks, and one of those can be another multiply that must not reuse the buffers still in use.
+    thread_local int activeCalls = 0;
+
+    // Per thread buffers, grown on demand and never shrunk, so steady state calls do not allocate. The packed
+    // B panel and the gathered vector are in use across a parallelFor, so there is one of each per nesting
+    // depth. A deque keeps the buffers of outer calls in place when a deeper one is added.
+    template <typename T>
+    std::vector<T>& packedAStorage() {
+        thread_local std::vector<T> storage;
+        return storage;
+    }
+
+    template <typename T>
+    std::vector<T>& packedBStorage(int depth) {
+        thread_local std::deque<std::vector<T>> storage;
+        while (storage.size() <= depth) storage.emplace_back();
+        return storage[depth];
+    }
+
+    template <typename T>
+    std::vector<T>& vectorStorage(int depth) {
+        thread_local std::deque<std::vector<T>> storage;
+        while (storage.size() <= depth) storage.emplace_back();
+        return storage[depth];
+    }
+
+    struct activeCallGuard {
+        activeCallGuard() { activeCalls++; }
+        ~activeCallGuard() { activeCalls--; }
+    };
+
+    // Returns a cache line aligned pointer into storage with room for size elements.
+    template <typename T>
+    T* packingBuffer(std::vector<T>& storage, size_t size) {
+        const size_t alignment = 64 / sizeof(T);
+        if (storage.size() < size + alignment) storage.resize(size + alignment);
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+        return reinterpret_cast<T*>((address + 63) & ~uintptr_t(63));
+    }
+
+    // Packs an mc x kc block of A into MR row slivers, each stored column by column. Rows past mc are zero.
+    template <typename T>
+    void packA(int mc, int kc, const T* A, long rowStrideA, long columnStrideA, T* packed) {
+        const int MR = blocking<T>::MR;
+        for (int ir = 0; ir < mc; ir += MR) {
+            int mr = std::min(MR, mc - ir);
+            for (int p = 0; p < kc; p++) {
+                for (int i = 0; i < mr; i++) {
+                    packed[i] = A[rowStrideA * (ir + i) + columnStrideA * p];
+                }
+                for (int i = mr; i < MR; i++) {
+                    packed[i] = 0;
+                }
+                packed += MR;
+            }
+        }
+    }
+
+    // Packs the NR column slivers [firstSliver, lastSliver) of a kc x nc block of B, each stored row by row.
+    // Columns past nc are zero.
+    template <typename T>
+    void packB(int nc, int kc, const T* B, long rowStrideB, long columnStrideB, T* packed, int firstSliver, int lastSliver) {
+        const int NR = blocking<T>::NR;
+        for (int sliver = firstSliver; sliver < lastSliver; sliver++) {
+            int jr = sliver * NR;
+            int nr = std::min(NR, nc - jr);
+            T* out = packed + (long)sliver * NR * kc;
+            for (int p = 0; p < kc; p++) {
+                for (int j = 0; j < nr; j++) {
+                    out[j] = B[rowStrideB * p + columnStrideB * (jr + j)];
+                }
+                for (int j = nr; j < NR; j++) {
+                    out[j] = 0;
+                }
+                out += NR;
+            }
+        }
+    }
+
+    // Runs the microkernel over every tile of an mc x nc block of C. Partial tiles on the edges are
+    // computed into a scratch tile and then copied into C.
+    template <typename T>
+    void macroKernel(int mc, int nc, int kc, T alpha, const T* packedA, const T* packedB,
+        T beta, T* C, long rowStrideC, int firstSliver, int lastSliver) {
+        const int MR = blocking<T>::MR;
+        const int NR = blocking<T>::NR;
+        void (*microkernel)(int, const T*, const T*, T, T, T*, long) = useAvx2 ? avx2Kernel<T> : scalarKernel<T>;
+        alignas(64) T edgeTile[MR * NR];
+
+        for (int sliver = firstSliver; sliver < lastSliver; sliver++) {
+            int jr = sliver * NR;
+            int nr = std::min(NR, nc - jr);
+            const T* b = packedB + (long)sliver * NR * kc;
+
+            for (int ir = 0; ir < mc; ir += MR) {
+                int mr = std::min(MR, mc - ir);
+                const T* a = packedA + (long)ir * kc;
+                T* c = C + rowStrideC * ir + jr;
+
+                if (mr == MR && nr == NR) {
+                    microkernel(kc, a, b, alpha, beta, c, rowStrideC);
+                    continue;
+                }
+
+                microkernel(kc, a, b, alpha, 0, edgeTile, NR);
+                for (int i = 0; i < mr; i++) {
+                    for (int j = 0; j < nr; j++) {
+                        T value = edgeTile[NR * i + j];
+                        c[rowStrideC * i + j] = beta == 0 ? value : value + beta * c[rowStrideC * i + j];
+                    }
+                }
+            }
+        }
+    }
+
+    // Straightforward i-k-j loop for products too small to be worth packing.
+    template <typename T>
+    void smallMultiply(int m, int n, int k, T alpha,
+        const T* A, long rowStrideA, long columnStrideA,
+        const T* B, long rowStrideB, long columnStrideB,
+        T beta, T* C, long rowStrideC) {
+        for (int i = 0; i < m; i++) {
+            T* row = C + rowStrideC * i;
+            for (int j = 0; j < n; j++) {
+                row[j] = beta == 0 ? 0 : beta * row[j];
+            }
+            for (int p = 0; p < k; p++) {
+                T a = alpha * A[rowStrideA * i + columnStrideA * p];
+                const T* b = B + rowStrideB * p;
+                for (int j = 0; j < n; j++) {
+                    row[j] += a * b[columnStrideB * j];
+                }
+            }
+        }
+    }
+
+    // Dot products of the rows [firstRow, lastRow) of a row major A with a contiguous x.
+    template <typename T>
+    void scalarRowDots(int firstRow, int lastRow, int n, const T* A, long rowStrideA, const T* x, T* dots) {
+        for (int i = firstRow; i < lastRow; i++) {
+            const T* row = A + rowStrideA * i;
+            T dot = 0;
+            for (int j = 0; j < n; j++) {
+                dot += row[j] * x[j];
+            }
+            dots[i - firstRow] = dot;
+        }
+    }
+
+    // Same as scalarRowDots, four rows at a time so every load of x is shared by four rows. Each row keeps two
+    // accumulators to hide the latency of the FMAs.
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2RowDots(int firstRow, int lastRow, int n, const T* A, long rowStrideA, const T* x, T* dots) {
+        typedef avx2Vector<T> V;
+        const int W = V::width;
+
+        int i = firstRow;
+        for (; i + 4 <= lastRow; i += 4) {
+            const T* rows[4] = { A + rowStrideA * i, A + rowStrideA * (i + 1), A + rowStrideA * (i + 2), A + rowStrideA * (i + 3) };
+            typename V::type first[4], second[4];
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                first[r] = V::zero();
+                second[r] = V::zero();
+            }
+
+            int j = 0;
+            for (; j + 2 * W <= n; j += 2 * W) {
+                typename V::type x0 = V::load(x + j);
+                typename V::type x1 = V::load(x + j + W);
+#pragma GCC unroll 4
+                for (int r = 0; r < 4; r++) {
+                    first[r] = V::fmadd(V::load(rows[r] + j), x0, first[r]);
+                    second[r] = V::fmadd(V::load(rows[r] + j + W), x1, second[r]);
+                }
+            }
+
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                T dot = V::sum(V::add(first[r], second[r]));
+                for (int tail = j; tail < n; tail++) {
+                    dot += rows[r][tail] * x[tail];
+                }
+                dots[i - firstRow + r] = dot;
+            }
+        }
+
+        for (; i < lastRow; i++) {
+            const T* row = A + rowStrideA * i;
+            typename V::type first = V::zero(), second = V::zero();
+            int j = 0;
+            for (; j + 2 * W <= n; j += 2 * W) {
+                first = V::fmadd(V::load(row + j), V::load(x + j), first);
+                second = V::fmadd(V::load(row + j + W), V::load(x + j + W), second);
+            }
+            T dot = V::sum(V::add(first, second));
+            for (; j < n; j++) {
+                dot += row[j] * x[j];
+            }
+            dots[i - firstRow] = dot;
+        }
+    }
+
+    // Computes A x for the rows [firstRow, lastRow) of an A whose columns are contiguous (A[i + columnStrideA * j]),
+    // such as a transposed weight matrix. Works through the columns as a sum of scaled columns, so every load of
+    // A is contiguous.
+    template <typename T>
+    void scalarColumnSums(int firstRow, int lastRow, int n, const T* A, long columnStrideA, const T* x, T* dots) {
+        for (int i = firstRow; i < lastRow; i++) {
+            dots[i - firstRow] = 0;
+        }
+        for (int j = 0; j < n; j++) {
+            const T* column = A + columnStrideA * j;
+            T xj = x[j];
+            for (int i = firstRow; i < lastRow; i++) {
+                dots[i - firstRow] += column[i] * xj;
+            }
+        }
+    }
+
+    // Blocks of four vectors of rows keep their partial sums in registers for the whole pass over the columns.
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void avx2ColumnSums(int firstRow, int lastRow, int n, const T* A, long columnStrideA, const T* x, T* dots) {
+        typedef avx2Vector<T> V;
+        const int W = V::width;
+
+        int i = firstRow;
+        for (; i + 4 * W <= lastRow; i += 4 * W) {
+            typename V::type sums[4] = { V::zero(), V::zero(), V::zero(), V::zero() };
+            for (int j = 0; j < n; j++) {
+                const T* column = A + columnStrideA * j + i;
+                typename V::type xj = V::broadcast(x + j);
+#pragma GCC unroll 4
+                for (int v = 0; v < 4; v++) {
+                    sums[v] = V::fmadd(V::load(column + v * W), xj, sums[v]);
+                }
+            }
+#pragma GCC unroll 4
+            for (int v = 0; v < 4; v++) {
+                V::store(dots + (i - firstRow) + v * W, sums[v]);
+            }
+        }
+
+        if (i < lastRow) {
+            scalarColumnSums(i, lastRow, n, A, columnStrideA, x, dots + (i - firstRow));
+        }
+    }
+
+    // biases, when given, are added to y after the product, and applySigmoid passes the result through the
+    // sigmoid while it is still in a block on the stack, see gemm::multiplyAddSigmoid.
+    template <typename T>
+    void multiplyVector(int m, int n, T alpha,
+        const T* A, long rowStrideA, long columnStrideA,
+        const T* x, long strideX,
+        T beta, T* y, long strideY,
+        const T* biases = nullptr, long strideBiases = 0, bool applySigmoid = false) {
+        if (m <= 0) return;
+
+        // The kernels want a contiguous x, strided vectors are gathered into a scratch buffer first.
+        std::vector<T>& xStorage = vectorStorage<T>(activeCalls);
+        activeCallGuard guard;
+        if (strideX != 1) {
+            if (xStorage.size() < (size_t)n) xStorage.resize(n);
+            for (int j = 0; j < n; j++) {
+                xStorage[j] = x[strideX * j];
+            }
+            x = xStorage.data();
+        }
+
+        auto rowDots = useAvx2 ? avx2RowDots<T> : scalarRowDots<T>;
+        auto columnSums = useAvx2 ? avx2ColumnSums<T> : scalarColumnSums<T>;
+
+        auto rowLoop = [&](int firstRow, int lastRow) {
+            // Dots are computed in blocks of rows on the stack, then scaled and activated into y.
+            const int blockRows = 64;
+            T dots[blockRows];
+            for (int i = firstRow; i < lastRow; i += blockRows) {
+                int iMax = std::min(i + blockRows, lastRow);
+                if (columnStrideA == 1) rowDots(i, iMax, n, A, rowStrideA, x, dots);
+                else if (rowStrideA == 1) columnSums(i, iMax, n, A, columnStrideA, x, dots);
+                else {
+                    for (int r = i; r < iMax; r++) {
+                        T dot = 0;
+                        for (int j = 0; j < n; j++) {
+                            dot += A[rowStrideA * r + columnStrideA * j] * x[j];
+                        }
+                        dots[r - i] = dot;
+                    }
+                }
+
+                for (int r = i; r < iMax; r++) {
+                    T value = alpha * dots[r - i];
+                    if (beta != 0) value += beta * y[strideY * r];
+                    if (biases != nullptr) value += biases[strideBiases * r];
+                    dots[r - i] = value;
+                }
+                if (applySigmoid) activation::sigmoid(dots, dots, iMax - i);
+
+                for (int r = i; r < iMax; r++) {
+                    y[strideY * r] = dots[r - i];
+                }
+            }
+        };
+
+        // Chunks are multiples of 32 rows so that they line up with the blocks of the kernels.
+        if ((long)m * n >= vectorParallelThreshold) {
+            threadPool& pool = threadPool::getInstance();
+            int chunkSize = std::max(32, (m / (int)(2 * pool.getConcurrency()) + 31) / 32 * 32);
+            pool.parallelFor(0, m, chunkSize, rowLoop);
+        }
+        else {
+            rowLoop(0, m);
+        }
+    }
+
+    // With applySigmoid, every block of C is passed through the sigmoid right after the last pass over the
+    // shared dimension has written it, while the block is still in cache.
+    template <typename T>
+    void multiply(int m, int n, int k, T alpha,
+        const T* A, long rowStrideA, long columnStrideA,
+        const T* B, long rowStrideB, long columnStrideB,
+        T beta, T* C, long rowStrideC, bool applySigmoid = false) {
+        const int MR = blocking<T>::MR;
+        const int NR = blocking<T>::NR;
+        const int KC = blocking<T>::KC;
+        const int MC = blocking<T>::MC;
+        const int NC = blocking<T>::NC;
+
+        if (m <= 0 || n <= 0) return;
+
+        // Matrix-vector products do not benefit from packing, C is a column or a row vector.
+        if (n == 1 && k > 0) {
+            multiplyVector(m, k, alpha, A, rowStrideA, columnStrideA, B, rowStrideB, beta, C, rowStrideC, (const T*)nullptr, 0, applySigmoid);
+            return;
+        }
+        if (m == 1 && k > 0) {
+            multiplyVector(n, k, alpha, B, columnStrideB, rowStrideB, A, columnStrideA, beta, C, 1, (const T*)nullptr, 0, applySigmoid);
+            return;
+        }
+
+        if (k <= 0 || alpha == 0 || (long)m * n * k < packingThreshold) {
+            smallMultiply(m, n, k, alpha, A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, beta, C, rowStrideC);
+            if (applySigmoid) {
+                for (int i = 0; i < m; i++) {
+                    activation::sigmoid(C + rowStrideC * i, C + rowStrideC * i, n);
+                }
+            }
+            return;
+        }
+
+        threadPool& pool = threadPool::getInstance();
+        bool parallel = (long)m * n * k >= parallelThreshold;
+
+        // The packed B panel is read by every thread working on this call.
+        std::vector<T>& bStorage = packedBStorage<T>(activeCalls);
+        activeCallGuard guard;
+
+        for (int jc = 0; jc < n; jc += NC) {
+            int nc = std::min(NC, n - jc);
+            int slivers = (nc + NR - 1) / NR;
+
+            for (int pc = 0; pc < k; pc += KC) {
+                int kc = std::min(KC, k - pc);
+                // Only the first pass over the shared dimension applies beta, later passes accumulate.
+                T passBeta = pc == 0 ? beta : 1;
+
+                const T* blockB = B + rowStrideB * pc + columnStrideB * jc;
+                T* packedB = packingBuffer(bStorage, (long)slivers * NR * kc);
+                auto packBLoop = [&](int firstSliver, int lastSliver) {
+                    packB(nc, kc, blockB, rowStrideB, columnStrideB, packedB, firstSliver, lastSliver);
+                };
+                if (parallel) pool.parallelFor(0, slivers, 0, packBLoop);
+                else packBLoop(0, slivers);
+
+                // Work is handed out as (row block, column range) pairs, the columns are only split when there
+                // are not enough row blocks to keep every thread busy.
+                int rowBlocks = (m + MC - 1) / MC;
+                int columnChunks = parallel ? std::max(1, std::min(slivers, (int)(2 * pool.getConcurrency()) / rowBlocks)) : 1;
+                int sliversPerChunk = (slivers + columnChunks - 1) / columnChunks;
+
+                auto blockLoop = [&](int firstTask, int lastTask) {
+                    for (int t = firstTask; t < lastTask; t++) {
+                        int ic = (t / columnChunks) * MC;
+                        int mc = std::min(MC, m - ic);
+                        int firstSliver = (t % columnChunks) * sliversPerChunk;
+                        int lastSliver = std::min(slivers, firstSliver + sliversPerChunk);
+                        if (firstSliver >= lastSliver) continue;
+
+                        T* packedA = packingBuffer(packedAStorage<T>(), (long)((mc + MR - 1) / MR) * MR * kc);
+                        packA(mc, kc, A + rowStrideA * ic + columnStrideA * pc, rowStrideA, columnStrideA, packedA);
+                        macroKernel(mc, nc, kc, alpha, packedA, packedB, passBeta, C + rowStrideC * ic + jc, rowStrideC, firstSliver, lastSliver);
+
+                        if (applySigmoid && pc + kc == k) {
+                            int firstColumn = jc + firstSliver * NR;
+                            int lastColumn = jc + std::min(nc, lastSliver * NR);
+                            for (int i = ic; i < ic + mc; i++) {
+                                activation::sigmoid(C + rowStrideC * i + firstColumn, C + rowStrideC * i + firstColumn, lastColumn - firstColumn);
+                            }
+                        }
+                    }
+                };
+                if (parallel) pool.parallelFor(0, rowBlocks * columnChunks, 1, blockLoop);
+                else blockLoop(0, rowBlocks * columnChunks);
+            }
+        }
+    }
+
+    // A single column goes through the matrix-vector kernel, which adds the biases and applies the sigmoid to
+    // each block of dot products before it is stored. Batches start C at the biases and accumulate onto them.
+    template <typename T>
+    void multiplyAddSigmoid(int m, int n, int k,
+        const T* A, long rowStrideA, long columnStrideA,
+        const T* B, long rowStrideB, long columnStrideB,
+        const T* biases, long strideBiases, T* C, long rowStrideC) {
+        if (m <= 0 || n <= 0) return;
+
+        if (n == 1) {
+            multiplyVector(m, k, T(1), A, rowStrideA, columnStrideA, B, rowStrideB, T(0), C, rowStrideC, biases, strideBiases, true);
+            return;
+        }
+
+        for (int i = 0; i < m; i++) {
+            std::fill(C + rowStrideC * i, C + rowStrideC * i + n, biases[strideBiases * i]);
+        }
+        multiply(m, n, k, T(1), A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, T(1), C, rowStrideC, true);
+    }
+}
+
+namespace gemm {
+    void multiply(int m, int n, int k, double alpha,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* B, long rowStrideB, long columnStrideB,
+        double beta, double* C, long rowStrideC) {
+        ::multiply<double>(m, n, k, alpha, A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, beta, C, rowStrideC);
+    }
+
+    void multiply(int m, int n, int k, float alpha,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* B, long rowStrideB, long columnStrideB,
+        float beta, float* C, long rowStrideC) {
+        ::multiply<float>(m, n, k, alpha, A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, beta, C, rowStrideC);
+    }
+
+    void multiplyVector(int m, int n, double alpha,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* x, long strideX,
+        double beta, double* y, long strideY) {
+        ::multiplyVector<double>(m, n, alpha, A, rowStrideA, columnStrideA, x, strideX, beta, y, strideY);
+    }
+
+    void multiplyVector(int m, int n, float alpha,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* x, long strideX,
+        float beta, float* y, long strideY) {
+        ::multiplyVector<float>(m, n, alpha, A, rowStrideA, columnStrideA, x, strideX, beta, y, strideY);
+    }
+
+    void multiplyAddSigmoid(int m, int n, int k,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* B, long rowStrideB, long columnStrideB,
+        const double* biases, long strideBiases, double* C, long rowStrideC) {
+        ::multiplyAddSigmoid<double>(m, n, k, A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, biases, strideBiases, C, rowStrideC);
+    }
+
+    void multiplyAddSigmoid(int m, int n, int k,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* B, long rowStrideB, long columnStrideB,
+        const float* biases, long strideBiases, float* C, long rowStrideC) {
+        ::multiplyAddSigmoid<float>(m, n, k, A, rowStrideA, columnStrideA, B, rowStrideB, columnStrideB, biases, strideBiases, C, rowStrideC);
+    }
+
+    const char* kernelName() {
+        return useAvx2 ? "avx2-fma 6x8 (double), 6x16 (float)" : "scalar 6x8 (double), 6x16 (float)";
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef LIBGEMM_H
+#define LIBGEMM_H
+
+// Low level matrix multiplication kernels used by the matrix class. Operands are raw pointers with explicit
+// strides, element (i, j) of an operand X lives at X[i * rowStrideX + j * columnStrideX]. This lets callers
+// pass transposed or strided data without copying it first. The output C is always row major. Every kernel
+// comes in a double and a float version.
+namespace gemm {
+    // Computes C = alpha * A * B + beta * C, where A is m x k, B is k x n, and C is m x n.
+    // When beta is 0, C is only written to and may hold uninitialized values.
+    void multiply(int m, int n, int k, double alpha,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* B, long rowStrideB, long columnStrideB,
+        double beta, double* C, long rowStrideC);
+
+    void multiply(int m, int n, int k, float alpha,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* B, long rowStrideB, long columnStrideB,
+        float beta, float* C, long rowStrideC);
+
+    // Computes y = alpha * A * x + beta * y, where A is m x n, x has n elements, and y has m elements.
+    // Row major and column major A both get a vectorized kernel, and large products are split by rows
+    // across the thread pool. When beta is 0, y is only written to.
+    void multiplyVector(int m, int n, double alpha,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* x, long strideX,
+        double beta, double* y, long strideY);
+
+    void multiplyVector(int m, int n, float alpha,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* x, long strideX,
+        float beta, float* y, long strideY);
+
+    // Computes C = sigmoid(A * B + biases), the activations of a layer, where biases is a column of m values
+    // added to every column of the product. The biases and the sigmoid are applied to each block of the
+    // result as soon as it is complete, rather than in separate passes over C. See activation.h for the sigmoid.
+    void multiplyAddSigmoid(int m, int n, int k,
+        const double* A, long rowStrideA, long columnStrideA,
+        const double* B, long rowStrideB, long columnStrideB,
+        const double* biases, long strideBiases, double* C, long rowStrideC);
+
+    void multiplyAddSigmoid(int m, int n, int k,
+        const float* A, long rowStrideA, long columnStrideA,
+        const float* B, long rowStrideB, long columnStrideB,
+        const float* biases, long strideBiases, float* C, long rowStrideC);
+
+    // Returns the name of the microkernel selected for this CPU.
+    const char* kernelName();
+}
+
+#endif
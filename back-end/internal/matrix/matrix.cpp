@@ -1,182 +1,107 @@
 #include "matrix.h"
-#include <thread>
+#include "gemm.h"
+#include "threadPool.h"
 #include <math.h>
 #include <algorithm>
 
-matrix::matrix() {
+template <typename T>
+basicMatrix<T>::basicMatrix() {
     this->rows = 0;
     this->columns = 0;
 }
 
-matrix::matrix(doubleArray_t data, int rows, int columns) {
+// The data is taken by value, so callers can move their buffer in instead of having it copied.
+template <typename T>
+basicMatrix<T>::basicMatrix(std::vector<T> data, int rows, int columns) {
     this->rows = rows;
     this->columns = columns;
 
-    if (data.size() == rows * columns) {
-        mData = data;
-    }
-    else {
+    if (data.size() != rows * columns) {
         data.resize(rows * columns);
-        mData = data;
     }
+    mData = std::move(data);
 }
 
-matrix::matrix(doubleArray_t data, int rowsColumns) {
+template <typename T>
+basicMatrix<T>::basicMatrix(std::vector<T> data, int rowsColumns) {
     this->rows = rowsColumns;
     this->columns = rowsColumns;
 
-    if (data.size() == rows * columns) {
-        mData = data;
-    }
-    else {
+    if (data.size() != rows * columns) {
         data.resize(rows * columns);
-        mData = data;
     }
+    mData = std::move(data);
 }
 
-matrix::matrix(twoDimDoubleArray_t data) {
+template <typename T>
+basicMatrix<T>::basicMatrix(std::vector<std::vector<T>> data) {
     this->rows = data.size();
-    this->columns = data[0].size();
+    this->columns = data.empty() ? 0 : data[0].size();
 
-    mData = doubleArray_t(rows * columns);
+    mData = std::vector<T>(rows * columns);
     for (int i = 0; i < rows; i++) {
+        if (data[i].size() != columns) throw std::invalid_argument("Every row of a matrix must have the same number of columns.");
         for (int j = 0; j < columns; j++) {
             mData[columns * i + j] = data[i][j];
         }
     }
 }
 
-matrix::~matrix() {
-
-}
-
-doubleArray_t matrix::getData() {
-    return mData;
-}
-
-unsigned int matrix::getRows() {
-    return rows;
-}
-
-unsigned int matrix::getColumns() {
-    return columns;
-}
-
-// Checks if two matrices have the same number of rows and columns
-bool matrix::sameDims(matrix M1, matrix M2) {
-    return M1.getColumns() == M2.getColumns() && M1.getRows() == M2.getRows();
-}
-
-// Piece-wise addition of two matrices
-matrix matrix::operator+(matrix m) {
-    if (!sameDims((*this), m)) {
-        throw std::logic_error("Mismatched dimensions between matrices.");
-    }
-
-    doubleArray_t operandData = m.getData();
-    doubleArray_t newData = doubleArray_t(rows * columns);
+// Copies the elements of a view into a new matrix.
+template <typename T>
+basicMatrix<T>::basicMatrix(const basicMatrixView<T>& view) {
+    this->rows = view.getRows();
+    this->columns = view.getColumns();
 
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
+    const T* viewData = view.getPointer();
+    long rowStride = view.getRowStride();
+    long columnStride = view.getColumnStride();
 
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    newData[columns * i + j] = mData[columns * i + j] + operandData[columns * i + j];
-                }
-            }
+    mData = std::vector<T>(rows * columns);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < columns; j++) {
+            mData[columns * i + j] = viewData[rowStride * i + columnStride * j];
         }
     }
-
-    return matrix(newData, rows, columns);
 }
 
-// Piece-wise subtraction of two matrices
-matrix matrix::operator-(matrix m) {
-    if (!sameDims((*this), m)) {
-        throw std::logic_error("Mismatched dimensions between matrices.");
-    }
-
-    doubleArray_t operandData = m.getData();
-    doubleArray_t newData = doubleArray_t(rows * columns);
+template <typename T>
+basicMatrix<T>::~basicMatrix() {
 
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
-
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    newData[columns * i + j] = mData[columns * i + j] - operandData[columns * i + j];
-                }
-            }
-        }
-    }
-
-    return matrix(newData, rows, columns);
 }
 
-// Piece-wise multiplication of two matrices
-matrix matrix::operator*(matrix m) {
-    if (!sameDims((*this), m)) {
-        throw std::logic_error("Mismatched dimensions between matrices.");
-    }
-
-    doubleArray_t operandData = m.getData();
-    doubleArray_t newData = doubleArray_t(rows * columns);
-
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
-
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    newData[columns * i + j] = mData[columns * i + j] * operandData[columns * i + j];
-                }
-            }
-        }
-    }
-
-    return matrix(newData, rows, columns);
+template <typename T>
+const std::vector<T>& basicMatrix<T>::getData() const {
+    return mData;
 }
 
-// Piece-wise division of two matrices
-matrix matrix::operator/(matrix m) {
-    if (!sameDims((*this), m)) {
-        throw std::logic_error("Mismatched dimensions between matrices.");
-    }
-
-    doubleArray_t operandData = m.getData();
-    doubleArray_t newData = doubleArray_t(rows * columns);
-
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
+template <typename T>
+unsigned int basicMatrix<T>::getRows() const {
+    return rows;
+}
 
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    newData[columns * i + j] = mData[columns * i + j] / operandData[columns * i + j];
-                }
-            }
-        }
-    }
+template <typename T>
+unsigned int basicMatrix<T>::getColumns() const {
+    return columns;
+}
 
-    return matrix(newData, rows, columns);
+template <typename T>
+void basicMatrix<T>::reshape(int rows, int columns) {
+    mData.resize((size_t)rows * columns);
+    this->rows = rows;
+    this->columns = columns;
 }
 
-matrix matrix::operator=(matrix m) {
-    mData = m.getData();
-    rows = m.getRows();
-    columns = m.getColumns();
-    return *this;
+// Checks if two matrices have the same number of rows and columns
+template <typename T>
+bool basicMatrix<T>::sameDims(const basicMatrix& M1, const basicMatrix& M2) {
+    return M1.getColumns() == M2.getColumns() && M1.getRows() == M2.getRows();
 }
 
 // Return the matrix element at the specified position (row, column)
-double matrix::operator()(unsigned int i, unsigned int j) {
-    if (i * j > mData.size() - 1) {
+template <typename T>
+T basicMatrix<T>::operator()(unsigned int i, unsigned int j) const {
+    if (i >= rows || j >= columns) {
         throw std::out_of_range("Index is out of range");
     }
 
@@ -184,11 +109,12 @@ double matrix::operator()(unsigned int i, unsigned int j) {
 }
 
 // Prints the first 10 rows and columns to standard output
-std::ostream& operator<<(std::ostream& os, matrix& M) {
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const basicMatrix<T>& M) {
     int maxDim = 10;
     int rows = std::min(maxDim, (int)M.rows);
     int columns = std::min(maxDim, (int)M.columns);
-    doubleArray_t* matrixData = &M.mData;
+    const std::vector<T>* matrixData = &M.mData;
 
     for (int i = 0; i < rows; i++) {
         for (int j = 0; j < columns; j++)
@@ -201,187 +127,230 @@ std::ostream& operator<<(std::ostream& os, matrix& M) {
 }
 
 // Returns the specified row
-matrix matrix::getRow(matrix M, int row) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::getRow(const basicMatrix& M, int row) {
     if (row >= M.rows) {
         throw std::logic_error("Row index out of range");
     }
 
-    std::vector<double> rowData;
-    for (int i = 0; i < M.columns; i++) {
-        rowData.push_back(M(row, i));
-    }
-    return matrix(rowData, 1, M.columns);
+    std::vector<T> rowData(M.mData.begin() + M.columns * row, M.mData.begin() + M.columns * (row + 1));
+    return basicMatrix(std::move(rowData), 1, M.columns);
 }
 
 // Returns the specified column
-matrix matrix::getColumn(matrix M, int column) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::getColumn(const basicMatrix& M, int column) {
     if (column >= M.columns) {
         throw std::logic_error("Column index out of range");
     }
 
-    std::vector<double> columnData;
+    std::vector<T> columnData(M.rows);
     for (int i = 0; i < M.rows; i++) {
-        columnData.push_back(M(i, column));
+        columnData[i] = M.mData[M.columns * i + column];
     }
-    return matrix(columnData, M.rows, 1);
+    return basicMatrix(std::move(columnData), M.rows, 1);
 }
 
-// Returns the input matrix with its elements multiplied by a scalar
-matrix matrix::scalarMultiply(matrix M, double scalar) {
-    int rows = M.rows;
-    int columns = M.columns;
+// Returns a 1 x n view of the specified row, without copying it
+template <typename T>
+basicMatrixView<T> basicMatrix<T>::getRowView(const basicMatrixView<T>& M, int row) {
+    if (row >= M.getRows()) {
+        throw std::logic_error("Row index out of range");
+    }
 
-    doubleArray_t newData = doubleArray_t(rows * columns);
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            newData[columns * i + j] = scalar * M(i, j);
-        }
+    return basicMatrixView<T>(M.getPointer() + M.getRowStride() * row, 1, M.getColumns(), M.getRowStride(), M.getColumnStride());
+}
+
+// Returns a m x 1 view of the specified column, without copying it
+template <typename T>
+basicMatrixView<T> basicMatrix<T>::getColumnView(const basicMatrixView<T>& M, int column) {
+    if (column >= M.getColumns()) {
+        throw std::logic_error("Column index out of range");
     }
-    return matrix(newData, rows, columns);
+
+    return basicMatrixView<T>(M.getPointer() + M.getColumnStride() * column, M.getRows(), 1, M.getRowStride(), M.getColumnStride());
+}
+
+// Returns a view of the rows x columns block whose top left element is at (row, column), without copying it
+template <typename T>
+basicMatrixView<T> basicMatrix<T>::getBlockView(const basicMatrixView<T>& M, int row, int column, int rows, int columns) {
+    if (row < 0 || column < 0 || rows < 0 || columns < 0 || row + rows > M.getRows() || column + columns > M.getColumns()) {
+        throw std::logic_error("Block is out of range");
+    }
+
+    return basicMatrixView<T>(M.getPointer() + M.getRowStride() * row + M.getColumnStride() * column, rows, columns, M.getRowStride(), M.getColumnStride());
+}
+
+// Returns a view of the transpose of the input, without copying it
+template <typename T>
+basicMatrixView<T> basicMatrix<T>::transposeView(const basicMatrixView<T>& M) {
+    return basicMatrixView<T>(M.getPointer(), M.getColumns(), M.getRows(), M.getColumnStride(), M.getRowStride());
 }
 
 // Returns the product of post-multiplication of the left matrix by the right matrix. Columns of the left
 // matrix must match the rows of the right matrix.
-matrix matrix::matrixMultiply(matrix leftMatrix, matrix rightMatrix) {
-    if (leftMatrix.columns != rightMatrix.rows) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::matrixMultiply(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix) {
+    basicMatrix result;
+    matrixMultiply(leftMatrix, rightMatrix, result);
+    return result;
+}
+
+template <typename T>
+void basicMatrix<T>::matrixMultiply(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, basicMatrix& result) {
+    if (leftMatrix.getColumns() != rightMatrix.getRows()) {
         throw std::logic_error("The number of columns of the left matrix must equal the number of rows of the right matrix.");
     }
 
-    const int MAX_THREADS = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
+    int rows = leftMatrix.getRows();
+    int columns = leftMatrix.getColumns();
+    int rmColumns = rightMatrix.getColumns();
 
-    int rows = leftMatrix.rows;
-    int columns = leftMatrix.columns;
-    int rmColumns = rightMatrix.columns;
+    result.reshape(rows, rmColumns);
 
-    doubleArray_t newData = doubleArray_t(rows * rmColumns);
+    // Views are handed to the kernels with their strides, so transposed or sliced operands are never copied.
+    // Column vectors (every layer of MLP::prediction) go straight to the matrix-vector kernel, which skips
+    // packing altogether. Everything else goes through the packed and blocked kernels in gemm.cpp.
+    if (rmColumns == 1) {
+        gemm::multiplyVector(rows, columns, T(1), leftMatrix.getPointer(), leftMatrix.getRowStride(), leftMatrix.getColumnStride(),
+            rightMatrix.getPointer(), rightMatrix.getRowStride(), T(0), result.mData.data(), 1);
+        return;
+    }
 
-    // Define block size so we can use matrix blocking (this is specific to my CPU and architecture).
-    // I tested various block sizes 8, 16, 32, 64, 128, 256, ..., and 64 seemed to perform the best.
-
-    auto matMulLoop = [&](int loopStart, int loopStep) {
-        // This outer loop sets up matrix blocking in one dimension. I found blocking in one dimension performed
-        // better than blocking in 2 or 3 dimensions.
-        for (int kk = 0; kk < columns; kk += blockSizeMultiply) {
-            int kkMin = std::min(kk + blockSizeMultiply, columns);
-            // Change loop order to maximize cache locality. Naive implementation is looping through i,j,k 
-            // where i is the # of rows of the left matrix, j is the # of columns of the right matrix, and k is the
-            // the number of multiplications between a row of the left matrix and column of the right matrix. Changing
-            // the loop order to i,k,j makes it more cache friendly, resulting in less cache misses and increased performance.
-            for (int i = loopStart; i < loopStart + loopStep; i++) {
-                for (int k = kk; k < kkMin; k++) {
-                    for (int j = 0; j < rmColumns; j++) {
-                        newData[rmColumns * i + j] += leftMatrix(i, k) * rightMatrix(k, j);
-                    }
-                }
-            }
-        }
-    };
+    gemm::multiply(rows, rmColumns, columns, T(1), leftMatrix.getPointer(), leftMatrix.getRowStride(), leftMatrix.getColumnStride(),
+        rightMatrix.getPointer(), rightMatrix.getRowStride(), rightMatrix.getColumnStride(), T(0), result.mData.data(), rmColumns);
+}
 
-    // Check if the matrices are larger than 300x300 (approximately). If they are then run
-    // the matrix multiplication with threading. Otherwise run w/o threading. The overhead 
-    // of initializing the threads makes using threading for small matrices inefficient.
-    if (rows + columns + rmColumns >= 900) {
-        // Divide matrix rows into equal sizes for each thread
-        int intDiv = rows / MAX_THREADS;
-        int remainder = rows % MAX_THREADS;
-        // Keeps track of where each matrix multiplication loop starts
-        int loopStart = 0;
-        for (int i = 0; i < MAX_THREADS; i++) {
-            if (i < remainder) {
-                threads.emplace_back(matMulLoop, loopStart, intDiv + 1);
-                loopStart += intDiv + 1;
-            }
-            else {
-                threads.emplace_back(matMulLoop, loopStart, intDiv);
-                loopStart += intDiv;
-            }
-        }
+// Returns the product of the left matrix and the right matrix plus biases, a column vector with one element
+// per row of the product that is added to every column. With a batch of inputs as the columns of the right
+// matrix, every input gets the same biases. The product accumulates straight onto the biases.
+template <typename T>
+basicMatrix<T> basicMatrix<T>::matrixMultiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases) {
+    basicMatrix result;
+    matrixMultiplyAdd(leftMatrix, rightMatrix, biases, result);
+    return result;
+}
 
-        for (int i = 0; i < MAX_THREADS; i++) {
-            threads[i].join();
-        }
+template <typename T>
+void basicMatrix<T>::matrixMultiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases, basicMatrix& result) {
+    if (leftMatrix.getColumns() != rightMatrix.getRows()) {
+        throw std::logic_error("The number of columns of the left matrix must equal the number of rows of the right matrix.");
     }
-    else {
-        matMulLoop(0, rows);
+
+    if (biases.getRows() != leftMatrix.getRows() || biases.getColumns() != 1) {
+        throw std::logic_error("The biases must be a column with one element per row of the product.");
+    }
+
+    int rows = leftMatrix.getRows();
+    int columns = leftMatrix.getColumns();
+    int rmColumns = rightMatrix.getColumns();
+
+    result.reshape(rows, rmColumns);
+    T* resultData = result.mData.data();
+    for (int i = 0; i < rows; i++) {
+        std::fill(resultData + rmColumns * i, resultData + rmColumns * (i + 1), biases.getPointer()[biases.getRowStride() * i]);
+    }
+
+    if (rmColumns == 1) {
+        gemm::multiplyVector(rows, columns, T(1), leftMatrix.getPointer(), leftMatrix.getRowStride(), leftMatrix.getColumnStride(),
+            rightMatrix.getPointer(), rightMatrix.getRowStride(), T(1), resultData, 1);
+        return;
     }
 
-    return matrix(newData, rows, rmColumns);
+    gemm::multiply(rows, rmColumns, columns, T(1), leftMatrix.getPointer(), leftMatrix.getRowStride(), leftMatrix.getColumnStride(),
+        rightMatrix.getPointer(), rightMatrix.getRowStride(), rightMatrix.getColumnStride(), T(1), resultData, rmColumns);
+}
+
+template <typename T>
+basicMatrix<T> basicMatrix<T>::matrixMultiplyAddSigmoid(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases) {
+    basicMatrix result;
+    matrixMultiplyAddSigmoid(leftMatrix, rightMatrix, biases, result);
+    return result;
+}
+
+template <typename T>
+void basicMatrix<T>::matrixMultiplyAddSigmoid(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases, basicMatrix& result) {
+    if (leftMatrix.getColumns() != rightMatrix.getRows()) {
+        throw std::logic_error("The number of columns of the left matrix must equal the number of rows of the right matrix.");
+    }
+
+    if (biases.getRows() != leftMatrix.getRows() || biases.getColumns() != 1) {
+        throw std::logic_error("The biases must be a column with one element per row of the product.");
+    }
+
+    int rows = leftMatrix.getRows();
+    int rmColumns = rightMatrix.getColumns();
+
+    result.reshape(rows, rmColumns);
+    gemm::multiplyAddSigmoid(rows, rmColumns, leftMatrix.getColumns(), leftMatrix.getPointer(), leftMatrix.getRowStride(), leftMatrix.getColumnStride(),
+        rightMatrix.getPointer(), rightMatrix.getRowStride(), rightMatrix.getColumnStride(), biases.getPointer(), biases.getRowStride(), result.mData.data(), rmColumns);
 }
 
 // Returns the transpose of the input matrix.
-matrix matrix::transpose(matrix M) {
-    const int MAX_THREADS = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
+template <typename T>
+basicMatrix<T> basicMatrix<T>::transpose(const basicMatrixView<T>& M) {
+    basicMatrix result;
+    transpose(M, result);
+    return result;
+}
 
-    int rows = M.rows;
-    int columns = M.columns;
+template <typename T>
+void basicMatrix<T>::transpose(const basicMatrixView<T>& M, basicMatrix& result) {
+    int rows = M.getRows();
+    int columns = M.getColumns();
+    const T* viewData = M.getPointer();
+    long rowStride = M.getRowStride();
+    long columnStride = M.getColumnStride();
 
-    doubleArray_t newData = doubleArray_t(rows * columns);
+    result.reshape(columns, rows);
+    T* newData = result.mData.data();
 
     // Define block size so we can use matrix blocking (this is specific to my CPU and architecture).
     // I tested various block sizes 8, 16, 32, 64, 128, 256, ..., and 8 seemed to perform the best.
 
-    auto matTransposeLoop = [&](int loopStart, int loopStep) {
-        for (int ii = loopStart; ii < loopStep; ii += blockSizeTranspose) {
+    // Loops over the row blocks [blockStart, blockEnd) of the matrix.
+    auto matTransposeLoop = [&](int blockStart, int blockEnd) {
+        for (int ii = blockStart * blockSizeTranspose; ii < std::min(blockEnd * blockSizeTranspose, rows); ii += blockSizeTranspose) {
             int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
             for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
                 int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
 
                 for (int i = ii; i < iiMin; i++) {
                     for (int j = jj; j < jjMin; j++) {
-                        newData[rows * j + i] = M(i, j);
+                        newData[rows * j + i] = viewData[rowStride * i + columnStride * j];
                     }
                 }
             }
         }
     };
 
-    // Check if the matrices are larger than 1024x1024 (approximately). If they are then run
-    // the matrix transpose with threading. Otherwise run w/o threading. The overhead 
-    // of initializing the threads makes using threading for small matrices inefficient.
-    if (rows + columns >= 2048) {
-        // Divide matrix rows into equal sizes for each thread
-        int intDiv = rows / MAX_THREADS;
-        int remainder = rows % MAX_THREADS;
-        // Keeps track of where each matrix multiplication loop starts
-        int loopStart = 0;
-        for (int i = 0; i < MAX_THREADS; i++) {
-            if (i < remainder) {
-                threads.emplace_back(matTransposeLoop, loopStart, intDiv + 1);
-                loopStart += intDiv + 1;
-            }
-            else {
-                threads.emplace_back(matTransposeLoop, loopStart, intDiv);
-                loopStart += intDiv;
-            }
-        }
-
-        for (int i = 0; i < MAX_THREADS; i++) {
-            threads[i].join();
-        }
+    // Hand out whole row blocks to the thread pool for larger matrices. A row block of M is a strip of columns
+    // of the result, so every thread writes its own elements, though neighbouring strips can share cache lines.
+    int rowBlocks = (rows + blockSizeTranspose - 1) / blockSizeTranspose;
+    if ((long)rows * columns >= parallelThreshold) {
+        threadPool::getInstance().parallelFor(0, rowBlocks, 0, matTransposeLoop);
     }
     else {
-        matTransposeLoop(0, rows);
+        matTransposeLoop(0, rowBlocks);
     }
-
-    return matrix(newData, columns, rows);
 }
 
 // Returns a n x n identity matrix.
-matrix matrix::identityMatrix(int n) {
-    doubleArray_t newData = doubleArray_t(n * n);
+template <typename T>
+basicMatrix<T> basicMatrix<T>::identityMatrix(int n) {
+    std::vector<T> newData = std::vector<T>(n * n);
 
     for (int i = 0; i < n; i++) {
         newData[n * i + i] = 1.0;
     }
 
-    return matrix(newData, n);
+    return basicMatrix(newData, n);
 }
 
 // Returns the Permutation matrix, Upper Triangular matrix, Lower Triangular matrix, and number of row swaps,
 // that result from performing LUP factorization/decomposition on the input matrix. This function only accepts square matrices.
-std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
+template <typename T>
+std::tuple<basicMatrix<T>, basicMatrix<T>, basicMatrix<T>, int> basicMatrix<T>::LUPDecompose(const basicMatrix& M) {
     if (M.rows != M.columns) {
         throw std::logic_error("The matrix must be square.");
     }
@@ -391,9 +360,9 @@ std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
 
     // permutations matrix data, we will use the extra index to store the 
     // number of row swaps which is needed when calculating the determinant
-    doubleArray_t pData = doubleArray_t(n * n);
+    std::vector<T> pData = std::vector<T>(n * n);
     // lower triangular matrix data
-    doubleArray_t lData = doubleArray_t(n * n);
+    std::vector<T> lData = std::vector<T>(n * n);
 
     // Initialize p-matrix and l-matrix data as identity matrices
     for (int i = 0; i < n; i++) {
@@ -402,16 +371,16 @@ std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
     }
 
     // upper triangular matrix data (which we initialize as a copy of the input matrix data)
-    doubleArray_t uData = M.getData();
+    std::vector<T> uData = M.getData();
 
     // Perform partial pivoting
     for (int i = 0; i < n; i++) {
 
-        double largestVal = 0.0;
+        T largestVal = 0.0;
         int largestValIndex = 0;
         // Iterate through each column and find the largest absolute value
         for (int j = i; j < n; j++) {
-            double absVal = std::abs(uData[n * j + i]);
+            T absVal = std::abs(uData[n * j + i]);
             if (absVal > largestVal) {
                 largestVal = absVal;
                 largestValIndex = n * j + i;
@@ -424,11 +393,11 @@ std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
 
             // Swap rows of upper matrix (which is a copy of input matrix) and permutation matrix
             for (int j = 0; j < n; j++) {
-                double inputTemp = uData[n * i + j];
+                T inputTemp = uData[n * i + j];
                 uData[n * i + j] = uData[n * largestValRow + j];
                 uData[n * largestValRow + j] = inputTemp;
 
-                double permutationTemp = pData[n * i + j];
+                T permutationTemp = pData[n * i + j];
                 pData[n * i + j] = pData[n * largestValRow + j];
                 pData[n * largestValRow + j] = permutationTemp;
 
@@ -442,7 +411,7 @@ std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
         // Iterate through all (n - i + 1) rows
         for (int j = i + 1; j < n; j++) {
             // Multiplier is used to multiply each value in row j and is used in the lower matrix
-            double multiplier = uData[n * j + i] / uData[(n * i + i)];
+            T multiplier = uData[n * j + i] / uData[(n * i + i)];
             // Iterate through all columns in row j
             for (int k = i; k < n; k++) {
                 uData[n * j + k] -= multiplier * uData[(n * i) + k];
@@ -453,16 +422,17 @@ std::tuple<matrix, matrix, matrix, int> matrix::LUPDecompose(matrix M) {
     }
 
     // Create all return matrices with the above calculated data
-    matrix pMatrix = matrix(pData, n);
-    matrix uMatrix = matrix(uData, n);
-    matrix lMatrix = matrix(lData, n);
+    basicMatrix pMatrix = basicMatrix(pData, n);
+    basicMatrix uMatrix = basicMatrix(uData, n);
+    basicMatrix lMatrix = basicMatrix(lData, n);
 
-    return std::tuple<matrix, matrix, matrix, int>(pMatrix, uMatrix, lMatrix, swaps);
+    return std::tuple<basicMatrix, basicMatrix, basicMatrix, int>(pMatrix, uMatrix, lMatrix, swaps);
 }
 
 // Solves Ax = b and returns the solution vector (x) to the input matrix(A) and vector (b).
 // Input matrix M must be square. Will only return unique solutions, throws error on non-unique solutions.
-matrix matrix::solve(matrix M, matrix vector) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::solve(const basicMatrix& M, const basicMatrix& vector) {
     auto [pMatrix, uMatrix, lMatrix, swaps] = LUPDecompose(M);
     return solveLUP(lMatrix, uMatrix, pMatrix, swaps, vector);
 }
@@ -471,11 +441,12 @@ matrix matrix::solve(matrix M, matrix vector) {
 // Matrices L, U, and P must be square and have the same dimensions.
 // Solves Ax=b and returns the solution vector (x) to the input matrix(PA = LU) and vector (b).
 // Will only return unique solutions, throws error on non-unique solutions.
-matrix matrix::solveLUP(matrix L, matrix U, matrix P, int swaps, matrix b) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::solveLUP(const basicMatrix& L, const basicMatrix& U, const basicMatrix& P, int swaps, const basicMatrix& b) {
     // Use threshold to check if value is near enough to zero.
-    double threshold = std::numeric_limits<double>::epsilon();
+    T threshold = std::numeric_limits<T>::epsilon();
     // If the determinant is (near) zero, then there is no unique solution.
-    double determinant = determinantLUP(L, U, swaps);
+    T determinant = determinantLUP(L, U, swaps);
     if (determinant < threshold && determinant > -threshold) {
         throw std::logic_error("There is no unique solution.");
     }
@@ -483,14 +454,14 @@ matrix matrix::solveLUP(matrix L, matrix U, matrix P, int swaps, matrix b) {
     int n = L.rows;
 
     // First solve Ly = Pb for y
-    doubleArray_t yData = doubleArray_t(n);
+    std::vector<T> yData = std::vector<T>(n);
 
     // Pb is a n*1 vector
-    matrix Pb = matrixMultiply(P, b);
+    basicMatrix Pb = matrixMultiply(P, b);
 
     // Iterate through each row of the lower matrix
     for (int i = 0; i < n; i++) {
-        double result = 0.0;
+        T result = 0.0;
         // Iterate through each column in the row upto (and including) the diagonal element
         for (int j = 0; j <= i; j++) {
             if (i == j) {
@@ -504,11 +475,11 @@ matrix matrix::solveLUP(matrix L, matrix U, matrix P, int swaps, matrix b) {
     }
 
     // Second we solve Ux = y for x
-    doubleArray_t xData = doubleArray_t(n);
+    std::vector<T> xData = std::vector<T>(n);
 
     // Iterate through each row of the upper matrix
     for (int i = n - 1; i >= 0; i--) {
-        double result = 0.0;
+        T result = 0.0;
         // Iterate through each column starting at the diagonal
         for (int j = i; j < n; j++) {
             if (i == j) {
@@ -521,18 +492,20 @@ matrix matrix::solveLUP(matrix L, matrix U, matrix P, int swaps, matrix b) {
         xData[i] = result;
     }
 
-    return matrix(xData, n, 1);
+    return basicMatrix(xData, n, 1);
 }
 
 // Returns the determinant of the input matrix. Input matrix must be square.
-double matrix::determinant(matrix M) {
+template <typename T>
+T basicMatrix<T>::determinant(const basicMatrix& M) {
     auto [_, uMatrix, lMatrix, swaps] = LUPDecompose(M);
     return determinantLUP(lMatrix, uMatrix, swaps);
 }
 
 // Takes in previously calculated Lower Triangular Matrix, Upper Triangular Matrix, and swaps.
 // Returns the determinant of the input matrix (PA = LU). Input matrices must be square and have same dimensions.
-double matrix::determinantLUP(matrix L, matrix U, int swaps) {
+template <typename T>
+T basicMatrix<T>::determinantLUP(const basicMatrix& L, const basicMatrix& U, int swaps) {
     if (L.columns != L.rows || U.columns != U.rows) {
         throw std::logic_error("One or more of the matrices provided are not square.");
     }
@@ -542,7 +515,7 @@ double matrix::determinantLUP(matrix L, matrix U, int swaps) {
     }
 
     int n = L.rows;
-    double result = 1.0;
+    T result = 1.0;
 
     for (int i = 0; i < n; i++) {
         result *= L(i, i) * U(i, i);
@@ -552,14 +525,16 @@ double matrix::determinantLUP(matrix L, matrix U, int swaps) {
 }
 
 // Returns the inverse of the input matrix. Input matrix must be square.
-matrix matrix::inverse(matrix M) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::inverse(const basicMatrix& M) {
     auto [pMatrix, uMatrix, lMatrix, swaps] = LUPDecompose(M);
     return inverseLUP(lMatrix, uMatrix, pMatrix, swaps);
 }
 
 // Takes in previously calculated Lower Triangular Matrix, Upper Triangular Matrix, Permutation Matrix, and swaps.
 // Returns the inverse of the input matrix by solving (A)(A^-1) = I. Input matrices must be square and have same dimensions.
-matrix matrix::inverseLUP(matrix L, matrix U, matrix P, int swaps) {
+template <typename T>
+basicMatrix<T> basicMatrix<T>::inverseLUP(const basicMatrix& L, const basicMatrix& U, const basicMatrix& P, int swaps) {
     if (L.rows != L.columns || U.rows != U.columns || P.rows != P.columns) {
         throw std::logic_error("One or more of the matrices provided are not square.");
     }
@@ -569,85 +544,79 @@ matrix matrix::inverseLUP(matrix L, matrix U, matrix P, int swaps) {
     }
 
     int n = L.rows;
-    doubleArray_t inverseMatData = doubleArray_t(n * n);
+    std::vector<T> inverseMatData = std::vector<T>(n * n);
 
     for (int i = 0; i < n; i++) {
-        doubleArray_t identityCol = doubleArray_t(n);
+        std::vector<T> identityCol = std::vector<T>(n);
         identityCol[i] = 1.0;
-        doubleArray_t inverseCol = solveLUP(L, U, P, swaps, matrix(identityCol, n, 1)).mData;
+        std::vector<T> inverseCol = solveLUP(L, U, P, swaps, basicMatrix(identityCol, n, 1)).mData;
 
         for (int j = 0; j < n; j++) {
             inverseMatData[L.columns * j + i] = inverseCol[j];
         }
     }
 
-    return matrix(inverseMatData, n);
+    return basicMatrix(inverseMatData, n);
 }
 
-// Sums all elements together and returns the result.
-double matrix::sum(matrix M) {
-    int rows = M.rows;
-    int columns = M.columns;
-    double result = 0.0;
+template <typename T>
+basicMatrixView<T>::basicMatrixView(const T* data, int rows, int columns, long rowStride, long columnStride) {
+    this->mData = data;
+    this->rows = rows;
+    this->columns = columns;
+    this->rowStride = rowStride;
+    this->columnStride = columnStride;
+}
 
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
+// Views the whole matrix.
+template <typename T>
+basicMatrixView<T>::basicMatrixView(const basicMatrix<T>& M) {
+    this->mData = M.getData().data();
+    this->rows = M.getRows();
+    this->columns = M.getColumns();
+    this->rowStride = M.getColumns();
+    this->columnStride = 1;
+}
 
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    result += M(i, j);
-                }
-            }
-        }
-    }
+template <typename T>
+const T* basicMatrixView<T>::getPointer() const {
+    return mData;
+}
 
-    return result;
+template <typename T>
+unsigned int basicMatrixView<T>::getRows() const {
+    return rows;
 }
 
+template <typename T>
+unsigned int basicMatrixView<T>::getColumns() const {
+    return columns;
+}
 
-// Apply the given function to each element in the input matrix.
-matrix matrix::map(matrix M, double (*f)(double)) {
-    int rows = M.rows;
-    int columns = M.columns;
-    doubleArray_t mappedValues;
+template <typename T>
+long basicMatrixView<T>::getRowStride() const {
+    return rowStride;
+}
 
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
+template <typename T>
+long basicMatrixView<T>::getColumnStride() const {
+    return columnStride;
+}
 
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    mappedValues.push_back(f(M(i, j)));
-                }
-            }
-        }
+// Return the element at the specified position (row, column) of the view
+template <typename T>
+T basicMatrixView<T>::operator()(unsigned int i, unsigned int j) const {
+    if (i >= rows || j >= columns) {
+        throw std::out_of_range("Index is out of range");
     }
 
-    return matrix(mappedValues, M.rows, M.columns);
+    return mData[rowStride * i + columnStride * j];
 }
 
-// Apply the given function to each element in the input matrix.
-// Then sum all elements together and return the result.
-double matrix::mapSum(matrix M, double (*f)(double)) {
-    int rows = M.rows;
-    int columns = M.columns;
-    double result = 0.0;
-
-    for (int ii = 0; ii < rows; ii += blockSizeTranspose) {
-        int iiMin = std::min(ii + blockSizeTranspose, (int)rows);
-        for (int jj = 0; jj < columns; jj += blockSizeTranspose) {
-            int jjMin = std::min(jj + blockSizeTranspose, (int)columns);
-
-            for (int i = ii; i < iiMin; i++) {
-                for (int j = jj; j < jjMin; j++) {
-                    result += f(M(i, j));
-                }
-            }
-        }
-    }
-
-    return result;
-}
\ No newline at end of file
+// The element types a matrix can be instantiated with.
+template class basicMatrix<double>;
+template class basicMatrix<float>;
+template class basicMatrixView<double>;
+template class basicMatrixView<float>;
+template std::ostream& operator<<(std::ostream& os, const basicMatrix<double>& M);
+template std::ostream& operator<<(std::ostream& os, const basicMatrix<float>& M);
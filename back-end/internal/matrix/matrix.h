@@ -4,86 +4,362 @@
 #include <vector>
 #include <iostream>
 #include <tuple>
+#include "matrixExpression.h"
+#include "activation.h"
 
 typedef std::vector<double>              doubleArray_t;
 typedef std::vector<doubleArray_t>       twoDimDoubleArray_t;
+typedef std::vector<float>               floatArray_t;
+typedef std::vector<floatArray_t>        twoDimFloatArray_t;
 
-class matrix {
+template <typename T>
+class basicMatrixView;
+
+// A dense, row major matrix of T. Only float and double are supported, both are instantiated in matrix.cpp.
+// Most of the code uses the matrix (double) and floatMatrix typedefs below rather than this name.
+template <typename T>
+class basicMatrix : public matrixExpression<basicMatrix<T>> {
 
 private:
-    doubleArray_t mData;
+    std::vector<T> mData;
 
     unsigned int rows;
 
     unsigned int columns;
 
     inline static int blockSizeTranspose = 8;
-    inline static int blockSizeMultiply = 64;
+
+    // Minimum amount of work (multiply-adds or copied elements) before an operation is split across the thread pool.
+    inline static long parallelThreshold = 1 << 15;
+
+    // Evaluates an expression into this matrix in one pass, reusing the current storage when the size matches.
+    template <typename E>
+    void assign(const E& expression);
+
+    // The evaluation loop of assign, compiled once for the baseline instruction set and once for AVX2, which
+    // assign picks between at runtime. Every node of the expression is inlined into the loop, so the AVX2 copy
+    // vectorizes the whole expression with 256 bit registers.
+    template <typename O>
+    static void evaluate(const O& operand, T* out, size_t size);
+
+    template <typename O>
+    __attribute__((target("avx2,fma")))
+    static void evaluateAvx2(const O& operand, T* out, size_t size);
+
+    // Sets the dimensions of the matrix. The storage only grows, so reshaping to the same or a smaller size,
+    // or back up to a size it has held before, never allocates.
+    void reshape(int rows, int columns);
+
+    template <typename U>
+    friend std::ostream& operator<<(std::ostream& os, const basicMatrix<U>& m);
+
+    // Writes int8 products straight into a result matrix, see quantizedMatrix::multiplyAdd.
+    friend class quantizedMatrix;
+
+    // Writes sparse products into a result matrix, and updates weights in place, see sparseMatrix.
+    template <typename U>
+    friend class sparseMatrix;
 
 public:
-    matrix();
+    typedef T value_type;
+
+    basicMatrix();
+
+    basicMatrix(std::vector<T> data, int rows, int columns);
+
+    basicMatrix(std::vector<T> data, int n);
+
+    basicMatrix(std::vector<std::vector<T>>);
+
+    explicit basicMatrix(const basicMatrixView<T>& view);
+
+    // Converts a matrix with a different element type, e.g. double weights into float weights.
+    template <typename U>
+    explicit basicMatrix(const basicMatrix<U>& M);
+
+    basicMatrix(const basicMatrix& m) = default;
+
+    basicMatrix(basicMatrix&& m) = default;
+
+    template <typename E>
+    basicMatrix(const matrixExpression<E>& expression);
+
+    ~basicMatrix();
+
+    const std::vector<T>& getData() const;
+
+    unsigned int getRows() const;
+
+    unsigned int getColumns() const;
+
+    basicMatrix& operator=(const basicMatrix& m) = default;
+
+    basicMatrix& operator=(basicMatrix&& m) = default;
+
+    template <typename E>
+    basicMatrix& operator=(const matrixExpression<E>& expression);
+
+    // Returns the element at the given row major index, used when evaluating expressions
+    T element(size_t index) const {
+        return mData[index];
+    }
+
+    T operator()(unsigned int i, unsigned int j) const;
+
+    static bool sameDims(const basicMatrix& M, const basicMatrix& M2);
+
+    static basicMatrix getRow(const basicMatrix& M, int row);
+
+    static basicMatrix getColumn(const basicMatrix& M, int column);
+
+    static basicMatrixView<T> getRowView(const basicMatrixView<T>& M, int row);
 
-    matrix(doubleArray_t data, int rows, int columns);
+    static basicMatrixView<T> getColumnView(const basicMatrixView<T>& M, int column);
 
-    matrix(doubleArray_t data, int n);
+    static basicMatrixView<T> getBlockView(const basicMatrixView<T>& M, int row, int column, int rows, int columns);
 
-    matrix(twoDimDoubleArray_t);
+    static basicMatrixView<T> transposeView(const basicMatrixView<T>& M);
 
-    ~matrix();
+    template <typename E>
+    static scalarExpression<E, multiplyOp> scalarMultiply(const matrixExpression<E>& M, T scalar);
 
-    doubleArray_t getData();
+    static basicMatrix matrixMultiply(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix);
 
-    unsigned int getRows();
+    static basicMatrix matrixMultiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases);
 
-    unsigned int getColumns();
+    static basicMatrix transpose(const basicMatrixView<T>& M);
 
-    matrix operator+(matrix m);
+    // Returns sigmoid(leftMatrix * rightMatrix + biases), the activations of a neural network layer, computed in one
+    // pass over the result.
+    static basicMatrix matrixMultiplyAddSigmoid(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases);
 
-    matrix operator-(matrix m);
+    // The overloads below write into result instead of returning a new matrix, reusing its storage (see
+    // reshape), so they do not allocate once result has held a matrix of that size. result must not be
+    // viewed by any of the inputs.
+    static void matrixMultiply(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, basicMatrix& result);
 
-    matrix operator*(matrix m);
+    static void matrixMultiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases, basicMatrix& result);
 
-    matrix operator/(matrix m);
+    static void transpose(const basicMatrixView<T>& M, basicMatrix& result);
 
-    matrix operator=(matrix m);
+    static void matrixMultiplyAddSigmoid(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& rightMatrix, const basicMatrixView<T>& biases, basicMatrix& result);
 
-    double operator()(unsigned int i, unsigned int j);
+    static basicMatrix identityMatrix(int n);
 
-    friend std::ostream& operator<<(std::ostream& os, matrix& m);
+    static std::tuple<basicMatrix, basicMatrix, basicMatrix, int> LUPDecompose(const basicMatrix& M);
 
-    static bool sameDims(matrix M, matrix M2);
+    static basicMatrix solve(const basicMatrix& M, const basicMatrix& vector);
 
-    static matrix getRow(matrix M, int row);
+    static basicMatrix solveLUP(const basicMatrix& L, const basicMatrix& U, const basicMatrix& P, int swaps, const basicMatrix& vector);
 
-    static matrix getColumn(matrix M, int column);
+    static T determinant(const basicMatrix& M);
 
-    static matrix scalarMultiply(matrix M, double scalar);
+    static T determinantLUP(const basicMatrix& L, const basicMatrix& U, int swaps);
 
-    static matrix matrixMultiply(matrix leftMatrix, matrix rightMatrix);
+    static basicMatrix inverse(const basicMatrix& M);
 
-    static matrix transpose(matrix M);
+    static basicMatrix inverseLUP(const basicMatrix& L, const basicMatrix& U, const basicMatrix& P, int swaps);
 
-    static matrix identityMatrix(int n);
+    template <typename E>
+    static T sum(const matrixExpression<E>& M);
 
-    static std::tuple<matrix, matrix, matrix, int> LUPDecompose(matrix M);
+    template <typename E, typename F>
+    static mapExpression<E, F> map(const matrixExpression<E>& M, F f);
 
-    static matrix solve(matrix M, matrix vector);
+    // Same as map, evaluated into result. Mapping a matrix with one of the function objects of activation.h runs
+    // its SIMD kernel, anything else is evaluated as an expression. result may be M itself, and like the overloads
+    // above it does not allocate once result has held a matrix of that size.
+    template <typename E, typename F>
+    static void map(const matrixExpression<E>& M, F f, basicMatrix& result);
+
+    // Reducing a matrix with activation::squareFunction runs the SIMD sum of squares.
+    template <typename E, typename F>
+    static T mapSum(const matrixExpression<E>& M, F f);
+};
+
+typedef basicMatrix<double>              matrix;
+typedef basicMatrix<float>               floatMatrix;
+typedef basicMatrixView<double>          matrixView;
+typedef basicMatrixView<float>           floatMatrixView;
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const basicMatrix<T>& m);
+
+// Inside an expression a matrix is held as a pointer to its storage, which keeps the evaluation loop free
+// of indirections through the matrix object.
+template <typename T>
+class matrixOperand {
+
+private:
+    const T* mData;
+
+    unsigned int rows;
+
+    unsigned int columns;
+
+public:
+    typedef T value_type;
+
+    matrixOperand(const basicMatrix<T>& M) : mData(M.getData().data()), rows(M.getRows()), columns(M.getColumns()) {}
+
+    unsigned int getRows() const { return rows; }
+
+    unsigned int getColumns() const { return columns; }
+
+    T element(size_t index) const { return mData[index]; }
+};
+
+template <typename T>
+struct expressionOperand<basicMatrix<T>> {
+    typedef matrixOperand<T> type;
+};
+
+template <typename T>
+template <typename U>
+basicMatrix<T>::basicMatrix(const basicMatrix<U>& M) : mData(M.getData().begin(), M.getData().end()), rows(M.getRows()), columns(M.getColumns()) {}
+
+template <typename T>
+template <typename E>
+basicMatrix<T>::basicMatrix(const matrixExpression<E>& expression) : rows(0), columns(0) {
+    assign(expression.self());
+}
+
+template <typename T>
+template <typename E>
+basicMatrix<T>& basicMatrix<T>::operator=(const matrixExpression<E>& expression) {
+    assign(expression.self());
+    return *this;
+}
+
+// Element-wise expressions only combine matrices of the same size, so any matrix the expression reads from
+// has the size of the result. Assigning an expression to one of its own operands therefore never resizes
+// the storage it reads, and every element is read before it is overwritten.
+template <typename T>
+template <typename E>
+void basicMatrix<T>::assign(const E& expression) {
+    static_assert(std::is_same<typename E::value_type, T>::value,
+        "An expression can only be assigned to a matrix of the same element type, convert the matrix first.");
+
+    typename expressionOperand<E>::type operand(expression);
+    size_t size = (size_t)operand.getRows() * operand.getColumns();
+
+    if (mData.size() != size) mData.resize(size);
+    rows = operand.getRows();
+    columns = operand.getColumns();
+
+    if (activation::avx2Supported()) evaluateAvx2(operand, mData.data(), size);
+    else evaluate(operand, mData.data(), size);
+}
+
+template <typename T>
+template <typename O>
+void basicMatrix<T>::evaluate(const O& operand, T* out, size_t size) {
+#pragma GCC ivdep
+    for (size_t i = 0; i < size; i++) {
+        out[i] = operand.element(i);
+    }
+}
+
+template <typename T>
+template <typename O>
+__attribute__((target("avx2,fma")))
+void basicMatrix<T>::evaluateAvx2(const O& operand, T* out, size_t size) {
+#pragma GCC ivdep
+    for (size_t i = 0; i < size; i++) {
+        out[i] = operand.element(i);
+    }
+}
+
+// Returns the input matrix with its elements multiplied by a scalar
+template <typename T>
+template <typename E>
+scalarExpression<E, multiplyOp> basicMatrix<T>::scalarMultiply(const matrixExpression<E>& M, T scalar) {
+    return scalarExpression<E, multiplyOp>(M.self(), scalar);
+}
+
+// Sums all elements together and returns the result.
+template <typename T>
+template <typename E>
+T basicMatrix<T>::sum(const matrixExpression<E>& M) {
+    typename expressionOperand<E>::type operand(M.self());
+    size_t size = (size_t)operand.getRows() * operand.getColumns();
+
+    T result = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        result += operand.element(i);
+    }
+    return result;
+}
+
+// Apply the given function to each element in the input matrix.
+template <typename T>
+template <typename E, typename F>
+mapExpression<E, F> basicMatrix<T>::map(const matrixExpression<E>& M, F f) {
+    return mapExpression<E, F>(M.self(), f);
+}
+
+// Apply the given function to each element in the input matrix, writing the results into result.
+template <typename T>
+template <typename E, typename F>
+void basicMatrix<T>::map(const matrixExpression<E>& M, F f, basicMatrix& result) {
+    if constexpr (std::is_same<E, basicMatrix>::value && activation::arrayKernel<F>::exists) {
+        const basicMatrix& source = M.self();
+        result.reshape(source.rows, source.columns);
+        activation::arrayKernel<F>::apply(source.mData.data(), result.mData.data(), (long)source.mData.size());
+    }
+    else {
+        result = map(M, f);
+    }
+}
+
+// Apply the given function to each element in the input matrix.
+// Then sum all elements together and return the result.
+template <typename T>
+template <typename E, typename F>
+T basicMatrix<T>::mapSum(const matrixExpression<E>& M, F f) {
+    if constexpr (std::is_same<E, basicMatrix>::value && std::is_same<F, activation::squareFunction>::value) {
+        const basicMatrix& source = M.self();
+        return (T)activation::sumOfSquares(source.mData.data(), (long)source.mData.size());
+    }
+
+    return sum(map(M, f));
+}
+
+// A non-owning, strided window into the storage of a matrix. Element (i, j) of the view lives at
+// data[i * rowStride + j * columnStride], which lets rows, columns, blocks, and transposes share the
+// storage of the matrix they were taken from. A view must not outlive that matrix.
+template <typename T>
+class basicMatrixView {
+
+private:
+    const T* mData;
+
+    unsigned int rows;
+
+    unsigned int columns;
+
+    long rowStride;
+
+    long columnStride;
+
+public:
+    typedef T value_type;
 
-    static matrix solveLUP(matrix L, matrix U, matrix P, int swaps, matrix vector);
+    basicMatrixView(const T* data, int rows, int columns, long rowStride, long columnStride);
 
-    static double determinant(matrix M);
+    basicMatrixView(const basicMatrix<T>& M);
 
-    static double determinantLUP(matrix L, matrix U, int swaps);
+    const T* getPointer() const;
 
-    static matrix inverse(matrix M);
+    unsigned int getRows() const;
 
-    static matrix inverseLUP(matrix L, matrix U, matrix P, int swaps);
+    unsigned int getColumns() const;
 
-    static double sum(matrix M);
+    long getRowStride() const;
 
-    static matrix map(matrix M, double (*f)(double));
+    long getColumnStride() const;
 
-    static double mapSum(matrix M, double (*f)(double));
+    T operator()(unsigned int i, unsigned int j) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,150 @@
+#ifndef LIBMATRIXEXPRESSION_H
+#define LIBMATRIXEXPRESSION_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+// Element-wise matrix arithmetic is lazy. The operators below build a small tree of expression nodes, and
+// nothing is computed until the tree is assigned to a matrix (or reduced by matrix::sum / matrix::mapSum).
+// The whole tree is then evaluated in a single loop over the elements, so an expression like
+// scalarMultiply(a - b, 2.0) * (a * map(a, f)) makes one pass over memory and allocates at most its result.
+//
+// Every node exposes value_type, getRows(), getColumns(), and element(index), where index walks the elements
+// in row major order. Nested nodes are held by value, matrices are held by a pointer to their storage, so an
+// expression must be assigned to a matrix before the matrices it refers to go away. Both sides of a binary
+// expression must have the same element type, converting between float and double matrices is explicit.
+
+// Base of every expression node, E is the node type itself.
+template <typename E>
+class matrixExpression {
+public:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+};
+
+// How an operand is stored inside a node. Matrices specialize this in matrix.h.
+template <typename E>
+struct expressionOperand {
+    typedef E type;
+};
+
+struct addOp {
+    template <typename T>
+    static T apply(T left, T right) { return left + right; }
+};
+
+struct subtractOp {
+    template <typename T>
+    static T apply(T left, T right) { return left - right; }
+};
+
+struct multiplyOp {
+    template <typename T>
+    static T apply(T left, T right) { return left * right; }
+};
+
+struct divideOp {
+    template <typename T>
+    static T apply(T left, T right) { return left / right; }
+};
+
+// Piece-wise combination of two expressions with the same dimensions.
+template <typename L, typename R, typename Op>
+class binaryExpression : public matrixExpression<binaryExpression<L, R, Op>> {
+
+private:
+    typename expressionOperand<L>::type left;
+
+    typename expressionOperand<R>::type right;
+
+public:
+    typedef typename L::value_type value_type;
+
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+        "Both operands of an element-wise expression must have the same element type.");
+
+    binaryExpression(const L& left, const R& right) : left(left), right(right) {
+        if (left.getRows() != right.getRows() || left.getColumns() != right.getColumns()) {
+            throw std::logic_error("Mismatched dimensions between matrices.");
+        }
+    }
+
+    unsigned int getRows() const { return left.getRows(); }
+
+    unsigned int getColumns() const { return left.getColumns(); }
+
+    value_type element(size_t index) const { return Op::apply(left.element(index), right.element(index)); }
+};
+
+// Every element of an expression combined with the same scalar.
+template <typename E, typename Op>
+class scalarExpression : public matrixExpression<scalarExpression<E, Op>> {
+
+private:
+    typename expressionOperand<E>::type operand;
+
+public:
+    typedef typename E::value_type value_type;
+
+private:
+    value_type scalar;
+
+public:
+    scalarExpression(const E& operand, value_type scalar) : operand(operand), scalar(scalar) {}
+
+    unsigned int getRows() const { return operand.getRows(); }
+
+    unsigned int getColumns() const { return operand.getColumns(); }
+
+    value_type element(size_t index) const { return Op::apply(operand.element(index), scalar); }
+};
+
+// A function applied to every element of an expression. F is any callable, so lambdas are inlined into the
+// evaluation loop. The result of F is converted back to the element type of the expression.
+template <typename E, typename F>
+class mapExpression : public matrixExpression<mapExpression<E, F>> {
+
+private:
+    typename expressionOperand<E>::type operand;
+
+    F f;
+
+public:
+    typedef typename E::value_type value_type;
+
+    mapExpression(const E& operand, F f) : operand(operand), f(f) {}
+
+    unsigned int getRows() const { return operand.getRows(); }
+
+    unsigned int getColumns() const { return operand.getColumns(); }
+
+    value_type element(size_t index) const { return f(operand.element(index)); }
+};
+
+// Piece-wise addition of two matrices
+template <typename L, typename R>
+binaryExpression<L, R, addOp> operator+(const matrixExpression<L>& left, const matrixExpression<R>& right) {
+    return binaryExpression<L, R, addOp>(left.self(), right.self());
+}
+
+// Piece-wise subtraction of two matrices
+template <typename L, typename R>
+binaryExpression<L, R, subtractOp> operator-(const matrixExpression<L>& left, const matrixExpression<R>& right) {
+    return binaryExpression<L, R, subtractOp>(left.self(), right.self());
+}
+
+// Piece-wise multiplication of two matrices
+template <typename L, typename R>
+binaryExpression<L, R, multiplyOp> operator*(const matrixExpression<L>& left, const matrixExpression<R>& right) {
+    return binaryExpression<L, R, multiplyOp>(left.self(), right.self());
+}
+
+// Piece-wise division of two matrices
+template <typename L, typename R>
+binaryExpression<L, R, divideOp> operator/(const matrixExpression<L>& left, const matrixExpression<R>& right) {
+    return binaryExpression<L, R, divideOp>(left.self(), right.self());
+}
+
+#endif
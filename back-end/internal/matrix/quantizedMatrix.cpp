@@ -0,0 +1,290 @@
+#include "quantizedMatrix.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <immintrin.h>
+
+namespace {
+    // Rows and quantized columns are padded to a multiple of this many bytes, one AVX2 register.
+    const int padding = 32;
+
+    // Largest quantized value of the right hand side, see quantizedMatrix.h for why it is 7 bits.
+    const int inputLevels = 127;
+
+    // The kernels compute the int32 dot products of the rows [firstRow, lastRow) of A with the quantized
+    // column x. k is the padded length of the rows, a multiple of padding.
+    typedef void (*dotsKernel_t)(int firstRow, int lastRow, int k, const int8_t* A, long rowStride, const uint8_t* x, int32_t* dots);
+
+    void scalarDots(int firstRow, int lastRow, int k, const int8_t* A, long rowStride, const uint8_t* x, int32_t* dots) {
+        for (int i = firstRow; i < lastRow; i++) {
+            const int8_t* row = A + rowStride * i;
+            int32_t dot = 0;
+            for (int j = 0; j < k; j++) {
+                dot += (int32_t)x[j] * row[j];
+            }
+            dots[i - firstRow] = dot;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    int32_t horizontalSum(__m256i v) {
+        __m128i quad = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        __m128i pair = _mm_add_epi32(quad, _mm_unpackhi_epi64(quad, quad));
+        return _mm_cvtsi128_si32(_mm_add_epi32(pair, _mm_shuffle_epi32(pair, 1)));
+    }
+
+    // maddubs multiplies unsigned bytes of x with signed bytes of A and adds adjacent pairs into int16, madd
+    // against ones then widens the pairs into int32. Four rows at a time share every load of x.
+    __attribute__((target("avx2")))
+    void avx2Dots(int firstRow, int lastRow, int k, const int8_t* A, long rowStride, const uint8_t* x, int32_t* dots) {
+        const __m256i ones = _mm256_set1_epi16(1);
+
+        int i = firstRow;
+        for (; i + 4 <= lastRow; i += 4) {
+            const int8_t* rows[4] = { A + rowStride * i, A + rowStride * (i + 1), A + rowStride * (i + 2), A + rowStride * (i + 3) };
+            __m256i sums[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+            for (int j = 0; j < k; j += padding) {
+                __m256i xv = _mm256_loadu_si256((const __m256i*)(x + j));
+#pragma GCC unroll 4
+                for (int r = 0; r < 4; r++) {
+                    __m256i pairs = _mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(rows[r] + j)));
+                    sums[r] = _mm256_add_epi32(sums[r], _mm256_madd_epi16(pairs, ones));
+                }
+            }
+
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                dots[i - firstRow + r] = horizontalSum(sums[r]);
+            }
+        }
+
+        for (; i < lastRow; i++) {
+            const int8_t* row = A + rowStride * i;
+            __m256i sum = _mm256_setzero_si256();
+            for (int j = 0; j < k; j += padding) {
+                __m256i pairs = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(x + j)), _mm256_loadu_si256((const __m256i*)(row + j)));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones));
+            }
+            dots[i - firstRow] = horizontalSum(sum);
+        }
+    }
+
+    // VNNI does the multiply, the pairwise add, and the int32 accumulate of the AVX2 kernel in one instruction.
+    __attribute__((target("avx2,avx512vl,avx512vnni")))
+    void vnniDots(int firstRow, int lastRow, int k, const int8_t* A, long rowStride, const uint8_t* x, int32_t* dots) {
+        int i = firstRow;
+        for (; i + 4 <= lastRow; i += 4) {
+            const int8_t* rows[4] = { A + rowStride * i, A + rowStride * (i + 1), A + rowStride * (i + 2), A + rowStride * (i + 3) };
+            __m256i sums[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+            for (int j = 0; j < k; j += padding) {
+                __m256i xv = _mm256_loadu_si256((const __m256i*)(x + j));
+#pragma GCC unroll 4
+                for (int r = 0; r < 4; r++) {
+                    sums[r] = _mm256_dpbusd_epi32(sums[r], xv, _mm256_loadu_si256((const __m256i*)(rows[r] + j)));
+                }
+            }
+
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                dots[i - firstRow + r] = horizontalSum(sums[r]);
+            }
+        }
+
+        for (; i < lastRow; i++) {
+            const int8_t* row = A + rowStride * i;
+            __m256i sum = _mm256_setzero_si256();
+            for (int j = 0; j < k; j += padding) {
+                sum = _mm256_dpbusd_epi32(sum, _mm256_loadu_si256((const __m256i*)(x + j)), _mm256_loadu_si256((const __m256i*)(row + j)));
+            }
+            dots[i - firstRow] = horizontalSum(sum);
+        }
+    }
+
+    dotsKernel_t selectKernel() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) return vnniDots;
+        if (__builtin_cpu_supports("avx2")) return avx2Dots;
+        return scalarDots;
+    }
+
+    const dotsKernel_t dotsKernel = selectKernel();
+
+    // Number of multiply calls in progress on this thread, a nested call must not reuse the buffers below.
+    thread_local int activeCalls = 0;
+
+    // Per thread buffers for the quantized columns and their scales, grown on demand and never shrunk. There is
+    // one per nesting depth, like the buffers in gemm.cpp.
+    struct columnBuffers {
+        std::vector<uint8_t> columns;
+        std::vector<float> scales;
+    };
+
+    columnBuffers& columnStorage(int depth) {
+        thread_local std::deque<columnBuffers> storage;
+        while (storage.size() <= depth) storage.emplace_back();
+        return storage[depth];
+    }
+
+    struct activeCallGuard {
+        activeCallGuard() { activeCalls++; }
+        ~activeCallGuard() { activeCalls--; }
+    };
+}
+
+quantizedMatrix::quantizedMatrix() {
+    this->rows = 0;
+    this->columns = 0;
+    this->rowStride = 0;
+}
+
+// Quantizes every row of M with its own scale. Rows that are all zero get a scale of 1.
+template <typename T>
+quantizedMatrix::quantizedMatrix(const basicMatrix<T>& M) {
+    this->rows = M.getRows();
+    this->columns = M.getColumns();
+    this->rowStride = (columns + padding - 1) / padding * padding;
+
+    const std::vector<T>& data = M.getData();
+    mData = std::vector<int8_t>(rows * rowStride);
+    scales = std::vector<float>(rows);
+
+    for (int i = 0; i < rows; i++) {
+        const T* row = data.data() + (long)columns * i;
+        T largest = 0;
+        for (int j = 0; j < columns; j++) {
+            largest = std::max(largest, (T)std::abs(row[j]));
+        }
+
+        scales[i] = largest > 0 ? (float)(largest / 127) : 1.0f;
+        for (int j = 0; j < columns; j++) {
+            mData[rowStride * i + j] = (int8_t)std::lround(row[j] / scales[i]);
+        }
+    }
+}
+
+unsigned int quantizedMatrix::getRows() const {
+    return rows;
+}
+
+unsigned int quantizedMatrix::getColumns() const {
+    return columns;
+}
+
+const std::vector<int8_t>& quantizedMatrix::getData() const {
+    return mData;
+}
+
+long quantizedMatrix::getRowStride() const {
+    return rowStride;
+}
+
+const std::vector<float>& quantizedMatrix::getScales() const {
+    return scales;
+}
+
+template <typename T>
+basicMatrix<T> quantizedMatrix::multiply(const basicMatrixView<T>& M) const {
+    basicMatrix<T> result;
+    product<T>(M, nullptr, result);
+    return result;
+}
+
+template <typename T>
+basicMatrix<T> quantizedMatrix::multiplyAdd(const basicMatrixView<T>& M, const basicMatrixView<T>& biases) const {
+    basicMatrix<T> result;
+    multiplyAdd<T>(M, biases, result);
+    return result;
+}
+
+template <typename T>
+void quantizedMatrix::multiplyAdd(const basicMatrixView<T>& M, const basicMatrixView<T>& biases, basicMatrix<T>& result) const {
+    if (biases.getRows() != rows || biases.getColumns() != 1) {
+        throw std::logic_error("The biases must be a column with one element per row of the product.");
+    }
+
+    product<T>(M, &biases, result);
+}
+
+template <typename T>
+void quantizedMatrix::product(const basicMatrixView<T>& M, const basicMatrixView<T>* biases, basicMatrix<T>& result) const {
+    if (M.getRows() != columns) {
+        throw std::logic_error("The number of columns of the left matrix must equal the number of rows of the right matrix.");
+    }
+
+    int n = M.getColumns();
+    const T* input = M.getPointer();
+    long inputRowStride = M.getRowStride();
+    long inputColumnStride = M.getColumnStride();
+
+    columnBuffers& buffers = columnStorage(activeCalls);
+    std::vector<uint8_t>& quantizedColumns = buffers.columns;
+    std::vector<float>& columnScales = buffers.scales;
+    activeCallGuard guard;
+
+    if (quantizedColumns.size() < (size_t)n * rowStride) quantizedColumns.resize((size_t)n * rowStride);
+    if (columnScales.size() < (size_t)n) columnScales.resize(n);
+
+    // Quantize every column of M up front, each column is contiguous and zero padded to rowStride.
+    for (int j = 0; j < n; j++) {
+        const T* column = input + inputColumnStride * j;
+        T largest = 0;
+        for (int p = 0; p < columns; p++) {
+            largest = std::max(largest, column[inputRowStride * p]);
+        }
+
+        T scale = largest > 0 ? largest / inputLevels : 1;
+        T inverse = 1 / scale;
+        uint8_t* out = quantizedColumns.data() + rowStride * j;
+        for (int p = 0; p < columns; p++) {
+            T value = std::max((T)0, column[inputRowStride * p]);
+            out[p] = (uint8_t)std::min((T)inputLevels, value * inverse + (T)0.5);
+        }
+        std::fill(out + columns, out + rowStride, 0);
+        columnScales[j] = (float)scale;
+    }
+
+    result.reshape(rows, n);
+    T* newData = result.mData.data();
+
+    // Blocks of rows stay in cache while every column is multiplied with them.
+    const int blockRows = 64;
+    auto blockLoop = [&](int firstBlock, int lastBlock) {
+        int32_t dots[blockRows];
+        for (int i = firstBlock * blockRows; i < std::min(lastBlock * blockRows, (int)rows); i += blockRows) {
+            int iMax = std::min(i + blockRows, (int)rows);
+            for (int j = 0; j < n; j++) {
+                dotsKernel(i, iMax, rowStride, mData.data(), rowStride, quantizedColumns.data() + rowStride * j, dots);
+                for (int r = i; r < iMax; r++) {
+                    T bias = biases == nullptr ? 0 : biases->getPointer()[biases->getRowStride() * r];
+                    newData[(size_t)n * r + j] = (T)dots[r - i] * ((T)scales[r] * columnScales[j]) + bias;
+                }
+            }
+        }
+    };
+
+    int blocks = (rows + blockRows - 1) / blockRows;
+    if ((long)rows * rowStride * n >= parallelThreshold) {
+        threadPool::getInstance().parallelFor(0, blocks, 1, blockLoop);
+    }
+    else {
+        blockLoop(0, blocks);
+    }
+}
+
+const char* quantizedMatrix::kernelName() {
+    if (dotsKernel == vnniDots) return "avx512-vnni";
+    if (dotsKernel == avx2Dots) return "avx2 maddubs";
+    return "scalar";
+}
+
+template quantizedMatrix::quantizedMatrix(const basicMatrix<double>& M);
+template quantizedMatrix::quantizedMatrix(const basicMatrix<float>& M);
+template basicMatrix<double> quantizedMatrix::multiply(const basicMatrixView<double>& M) const;
+template basicMatrix<float> quantizedMatrix::multiply(const basicMatrixView<float>& M) const;
+template basicMatrix<double> quantizedMatrix::multiplyAdd(const basicMatrixView<double>& M, const basicMatrixView<double>& biases) const;
+template basicMatrix<float> quantizedMatrix::multiplyAdd(const basicMatrixView<float>& M, const basicMatrixView<float>& biases) const;
+template void quantizedMatrix::multiplyAdd(const basicMatrixView<double>& M, const basicMatrixView<double>& biases, basicMatrix<double>& result) const;
+template void quantizedMatrix::multiplyAdd(const basicMatrixView<float>& M, const basicMatrixView<float>& biases, basicMatrix<float>& result) const;
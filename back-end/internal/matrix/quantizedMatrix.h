@@ -0,0 +1,71 @@
+#ifndef LIBQUANTIZEDMATRIX_H
+#define LIBQUANTIZEDMATRIX_H
+
+#include <cstdint>
+#include <vector>
+#include "matrix.h"
+
+// A weight matrix quantized to int8 for inference. Every row has its own scale, row i is stored as
+// round(W(i, j) / scale[i]) with scale[i] = max |W(i, j)| / 127, so large and small rows keep the same
+// relative precision. Rows are zero padded to a multiple of 32 bytes so the kernels never handle a tail.
+//
+// Products with a quantized matrix quantize the right hand side on the fly, to 7 bits with one scale per
+// column, and accumulate in int32. The right hand side must not be negative, which holds for the inputs and
+// sigmoid activations of an MLP. 7 bits (rather than 8) keep the pairwise sums of the AVX2 maddubs kernel
+// from saturating int16, and every kernel uses them so results do not depend on the CPU.
+class quantizedMatrix {
+
+private:
+    std::vector<int8_t> mData;
+
+    std::vector<float> scales;
+
+    unsigned int rows;
+
+    unsigned int columns;
+
+    long rowStride;
+
+    // Minimum amount of multiply-adds before a product is split across the thread pool.
+    inline static long parallelThreshold = 1 << 18;
+
+    // Shared by multiply and multiplyAdd, biases is null when there are none.
+    template <typename T>
+    void product(const basicMatrixView<T>& M, const basicMatrixView<T>* biases, basicMatrix<T>& result) const;
+
+public:
+    quantizedMatrix();
+
+    template <typename T>
+    explicit quantizedMatrix(const basicMatrix<T>& M);
+
+    unsigned int getRows() const;
+
+    unsigned int getColumns() const;
+
+    // The quantized rows, each rowStride bytes long.
+    const std::vector<int8_t>& getData() const;
+
+    long getRowStride() const;
+
+    // One scale per row, the weight W(i, j) is approximately getData()[i * rowStride + j] * getScales()[i].
+    const std::vector<float>& getScales() const;
+
+    // Returns the dequantized product of this matrix and M, M must have getColumns() rows. A single column
+    // takes the matrix-vector path, several columns are multiplied as a batch.
+    template <typename T>
+    basicMatrix<T> multiply(const basicMatrixView<T>& M) const;
+
+    // Same as multiply, with a column of biases added to every column of the product like matrix::matrixMultiplyAdd.
+    template <typename T>
+    basicMatrix<T> multiplyAdd(const basicMatrixView<T>& M, const basicMatrixView<T>& biases) const;
+
+    // Same as multiplyAdd, written into result like the overloads of matrix::matrixMultiplyAdd that take one.
+    template <typename T>
+    void multiplyAdd(const basicMatrixView<T>& M, const basicMatrixView<T>& biases, basicMatrix<T>& result) const;
+
+    // Returns the name of the int8 kernel selected for this CPU.
+    static const char* kernelName();
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "sparseMatrix.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <stdexcept>
+
+template <typename T>
+sparseMatrix<T>::sparseMatrix() {
+    offsets = std::vector<long>(1, 0);
+    rows = 0;
+    columns = 0;
+}
+
+template <typename T>
+bool sparseMatrix<T>::compress(const basicMatrixView<T>& M, double maxDensity) {
+    int newRows = M.getRows();
+    int newColumns = M.getColumns();
+    const T* data = M.getPointer();
+    long rowStride = M.getRowStride();
+    long columnStride = M.getColumnStride();
+    long limit = (long)(maxDensity * newRows * newColumns);
+
+    // Room for the most entries a matrix of this size can have without being refused, clear keeps it, so compressing
+    // does not allocate again until a larger matrix comes along.
+    indices.clear();
+    values.clear();
+    indices.reserve(limit);
+    values.reserve(limit);
+    offsets.resize(newColumns + 1);
+    offsets[0] = 0;
+    for (int j = 0; j < newColumns; j++) {
+        const T* column = data + columnStride * j;
+        for (int i = 0; i < newRows; i++) {
+            T value = column[rowStride * i];
+            if (value == 0) continue;
+
+            if ((long)indices.size() == limit) {
+                indices.clear();
+                values.clear();
+                offsets.assign(1, 0);
+                rows = 0;
+                columns = 0;
+                return false;
+            }
+            indices.push_back(i);
+            values.push_back(value);
+        }
+        offsets[j + 1] = indices.size();
+    }
+
+    rows = newRows;
+    columns = newColumns;
+    return true;
+}
+
+template <typename T>
+unsigned int sparseMatrix<T>::getRows() const {
+    return rows;
+}
+
+template <typename T>
+unsigned int sparseMatrix<T>::getColumns() const {
+    return columns;
+}
+
+template <typename T>
+long sparseMatrix<T>::getEntries() const {
+    return indices.size();
+}
+
+template <typename T>
+void sparseMatrix<T>::multiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& biases, basicMatrix<T>& result) const {
+    if (leftMatrix.getColumns() != rows) {
+        throw std::logic_error("The number of columns of the left matrix must equal the number of rows of the right matrix.");
+    }
+
+    if (biases.getRows() != leftMatrix.getRows() || biases.getColumns() != 1) {
+        throw std::logic_error("The biases must be a column with one element per row of the product.");
+    }
+
+    int resultRows = leftMatrix.getRows();
+    const T* left = leftMatrix.getPointer();
+    long rowStride = leftMatrix.getRowStride();
+    long columnStride = leftMatrix.getColumnStride();
+
+    result.reshape(resultRows, columns);
+    T* newData = result.mData.data();
+
+    // Four rows of the left matrix at a time, each entry is loaded once for all four and the four sums add up independently
+    // of each other, instead of every multiply-add waiting on the one before it.
+    auto blockLoop = [&](int firstBlock, int lastBlock) {
+        for (int i = firstBlock * 4; i < std::min(lastBlock * 4, resultRows); i += 4) {
+            if (i + 4 > resultRows) {
+                for (int r = i; r < resultRows; r++) {
+                    const T* row = left + rowStride * r;
+                    for (int j = 0; j < columns; j++) {
+                        T sum = biases.getPointer()[biases.getRowStride() * r];
+                        for (long e = offsets[j]; e < offsets[j + 1]; e++) {
+                            sum += row[columnStride * indices[e]] * values[e];
+                        }
+                        newData[(size_t)columns * r + j] = sum;
+                    }
+                }
+                break;
+            }
+
+            const T* row = left + rowStride * i;
+            for (int j = 0; j < columns; j++) {
+                T sum0 = biases.getPointer()[biases.getRowStride() * i];
+                T sum1 = biases.getPointer()[biases.getRowStride() * (i + 1)];
+                T sum2 = biases.getPointer()[biases.getRowStride() * (i + 2)];
+                T sum3 = biases.getPointer()[biases.getRowStride() * (i + 3)];
+                for (long e = offsets[j]; e < offsets[j + 1]; e++) {
+                    long column = columnStride * indices[e];
+                    T value = values[e];
+                    sum0 += row[column] * value;
+                    sum1 += row[rowStride + column] * value;
+                    sum2 += row[2 * rowStride + column] * value;
+                    sum3 += row[3 * rowStride + column] * value;
+                }
+                newData[(size_t)columns * i + j] = sum0;
+                newData[(size_t)columns * (i + 1) + j] = sum1;
+                newData[(size_t)columns * (i + 2) + j] = sum2;
+                newData[(size_t)columns * (i + 3) + j] = sum3;
+            }
+        }
+    };
+
+    int blocks = (resultRows + 3) / 4;
+    if ((long)resultRows * getEntries() >= parallelThreshold) {
+        threadPool::getInstance().parallelFor(0, blocks, 1, blockLoop);
+    }
+    else {
+        blockLoop(0, blocks);
+    }
+}
+
+template <typename T>
+void sparseMatrix<T>::subtractOuterProducts(basicMatrix<T>& M, const basicMatrixView<T>& leftMatrix, T scale) const {
+    if (leftMatrix.getColumns() != columns || M.getRows() != leftMatrix.getRows() || M.getColumns() != rows) {
+        throw std::logic_error("The matrix must have a row per row of the left matrix and a column per row of the sparse matrix.");
+    }
+
+    int updatedRows = M.getRows();
+    const T* left = leftMatrix.getPointer();
+    long rowStride = leftMatrix.getRowStride();
+    long columnStride = leftMatrix.getColumnStride();
+    T* data = M.mData.data();
+
+    // Every row of M is only written by the loop that owns it.
+    auto rowLoop = [&](int firstRow, int lastRow) {
+        for (int i = firstRow; i < lastRow; i++) {
+            T* row = data + (size_t)rows * i;
+            for (int j = 0; j < columns; j++) {
+                T factor = scale * left[rowStride * i + columnStride * j];
+                if (factor == 0) continue;
+
+                for (long e = offsets[j]; e < offsets[j + 1]; e++) {
+                    row[indices[e]] -= factor * values[e];
+                }
+            }
+        }
+    };
+
+    if ((long)updatedRows * getEntries() >= parallelThreshold) {
+        threadPool::getInstance().parallelFor(0, updatedRows, 0, rowLoop);
+    }
+    else {
+        rowLoop(0, updatedRows);
+    }
+}
+
+// The element types a sparse matrix can be instantiated with.
+template class sparseMatrix<double>;
+template class sparseMatrix<float>;
@@ -0,0 +1,56 @@
+#ifndef LIBSPARSEMATRIX_H
+#define LIBSPARSEMATRIX_H
+
+#include <vector>
+#include "matrix.h"
+
+// A matrix of T stored as its non-zero entries, column by column (compressed sparse columns). Meant for the inputs of a
+// network's first layer, one example per column, which for drawn digits are mostly exact zeros: a product with a dense
+// weight matrix then only reads the weight columns of the non-zero inputs. Only float and double are supported, both are
+// instantiated in sparseMatrix.cpp.
+//
+// The kernels gather a handful of entries from every row of the dense matrix, which is slower per multiply-add than the
+// packed dense kernels, so compress refuses matrices that are too dense to gain from it and the caller falls back to them.
+template <typename T>
+class sparseMatrix {
+
+private:
+    // Entries of column j are [offsets[j], offsets[j + 1]).
+    std::vector<long> offsets;
+
+    std::vector<int> indices;
+
+    std::vector<T> values;
+
+    unsigned int rows;
+
+    unsigned int columns;
+
+    // Minimum amount of multiply-adds before a product is split across the thread pool.
+    inline static long parallelThreshold = 1 << 18;
+
+public:
+    sparseMatrix();
+
+    // Stores the non-zero entries of M, reusing the storage of this matrix, so compressing matrices of the same size
+    // again does not allocate. Returns false, and leaves this matrix empty, as soon as more than maxDensity of the
+    // entries of M turn out to be non-zero.
+    bool compress(const basicMatrixView<T>& M, double maxDensity);
+
+    unsigned int getRows() const;
+
+    unsigned int getColumns() const;
+
+    // Number of non-zero entries.
+    long getEntries() const;
+
+    // Writes leftMatrix * this + biases into result, biases being a column added to every column of the product like
+    // matrix::matrixMultiplyAdd. result must not be viewed by leftMatrix or biases.
+    void multiplyAdd(const basicMatrixView<T>& leftMatrix, const basicMatrixView<T>& biases, basicMatrix<T>& result) const;
+
+    // Subtracts scale * leftMatrix * transpose(this) from M in place, a sum of one outer product per column. Only the
+    // columns of M that belong to a row of this with a non-zero entry are read or written.
+    void subtractOuterProducts(basicMatrix<T>& M, const basicMatrixView<T>& leftMatrix, T scale) const;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "threadPool.h"
+#include <algorithm>
+#include <cstdlib>
+
+// The default worker count is one less than the hardware concurrency since the calling thread also works.
+// It can be overridden with the MATRIX_THREADS environment variable or setWorkerCount. MATRIX_SPIN sets how many
+// times an idle worker yields before it sleeps, see spinIterations.
+threadPool::threadPool() {
+    unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    const char* threadsEnv = std::getenv("MATRIX_THREADS");
+    if (threadsEnv != nullptr && std::atoi(threadsEnv) > 0) {
+        workerCount = std::atoi(threadsEnv) - 1;
+    }
+
+    const char* spinEnv = std::getenv("MATRIX_SPIN");
+    if (spinEnv != nullptr && std::atoi(spinEnv) >= 0) {
+        spinIterations = std::atoi(spinEnv);
+    }
+
+    start(workerCount);
+}
+
+threadPool::~threadPool() {
+    stop();
+}
+
+threadPool& threadPool::getInstance() {
+    static threadPool instance;
+    return instance;
+}
+
+unsigned int threadPool::getWorkerCount() {
+    return workers.size();
+}
+
+unsigned int threadPool::getConcurrency() {
+    return workers.size() + 1;
+}
+
+// Replaces the current workers with workerCount new ones. Must not be called while a parallelFor is running.
+void threadPool::setWorkerCount(unsigned int workerCount) {
+    stop();
+    start(workerCount);
+}
+
+void threadPool::start(unsigned int workerCount) {
+    stopping = false;
+    // The calling thread of parallelFor does not own a queue, so always keep at least one around.
+    for (unsigned int i = 0; i < std::max(1u, workerCount); i++) {
+        queues.push_back(std::make_unique<workerQueue>());
+    }
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&threadPool::workerLoop, this, i);
+    }
+}
+
+void threadPool::stop() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    sleepSignal.notify_all();
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    workers.clear();
+    queues.clear();
+}
+
+bool threadPool::push(unsigned int queueIndex, const task& t) {
+    workerQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.size == queueCapacity) return false;
+
+    queue.tasks[(queue.head + queue.size) % queueCapacity] = t;
+    queue.size++;
+    return true;
+}
+
+// Workers take the most recently pushed task from their own queue.
+bool threadPool::popBack(unsigned int queueIndex, task& t) {
+    workerQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.size == 0) return false;
+
+    queue.size--;
+    t = queue.tasks[(queue.head + queue.size) % queueCapacity];
+    pendingTasks.fetch_sub(1);
+    return true;
+}
+
+// Thieves take the oldest task from the front of someone else's queue.
+bool threadPool::stealFront(unsigned int queueIndex, task& t) {
+    workerQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.size == 0) return false;
+
+    t = queue.tasks[queue.head];
+    queue.head = (queue.head + 1) % queueCapacity;
+    queue.size--;
+    pendingTasks.fetch_sub(1);
+    return true;
+}
+
+// Looks for work in every queue, starting with firstQueue.
+bool threadPool::findTask(unsigned int firstQueue, task& t) {
+    if (pendingTasks.load() <= 0) return false;
+
+    for (int i = 0; i < queues.size(); i++) {
+        if (stealFront((firstQueue + i) % queues.size(), t)) return true;
+    }
+    return false;
+}
+
+void threadPool::execute(const task& t) {
+    job* owner = t.owner;
+    try {
+        owner->body(owner->context, t.begin, t.end);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> guard(owner->errorLock);
+        if (!owner->error) owner->error = std::current_exception();
+    }
+    // This must be the last access to the job, the calling thread is free to destroy it afterwards.
+    owner->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void threadPool::workerLoop(unsigned int index) {
+    int idleIterations = 0;
+    while (true) {
+        task t;
+        if (popBack(index, t) || findTask(index + 1, t)) {
+            execute(t);
+            idleIterations = 0;
+            continue;
+        }
+
+        if (idleIterations < (int)spinIterations) {
+            idleIterations++;
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleepLock);
+        sleepingWorkers.fetch_add(1);
+        sleepSignal.wait(guard, [this] { return stopping || pendingTasks.load() > 0; });
+        sleepingWorkers.fetch_sub(1);
+        if (stopping) return;
+        idleIterations = 0;
+    }
+}
+
+void threadPool::run(int begin, int end, int chunkSize, loopBody_t body, const void* context) {
+    if (end <= begin) return;
+
+    int range = end - begin;
+    if (chunkSize <= 0) {
+        // A few chunks per thread so faster threads can steal from slower ones.
+        chunkSize = std::max(1, range / (int)(4 * getConcurrency()));
+    }
+
+    int chunks = (range + chunkSize - 1) / chunkSize;
+    if (workers.empty() || chunks == 1) {
+        body(context, begin, end);
+        return;
+    }
+
+    job current;
+    current.body = body;
+    current.context = context;
+    current.remaining.store(chunks);
+
+    // Hand the chunks out to the worker queues round robin. The first chunk is kept for the calling thread,
+    // and a chunk that does not fit in a full queue is run by the calling thread as well.
+    unsigned int queueIndex = nextQueue.fetch_add(1);
+    for (int chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize) {
+        task t = { &current, chunkBegin, std::min(chunkBegin + chunkSize, end) };
+
+        pendingTasks.fetch_add(1);
+        if (!push(queueIndex++ % queues.size(), t)) {
+            pendingTasks.fetch_sub(1);
+            execute(t);
+        }
+    }
+
+    if (sleepingWorkers.load() > 0) {
+        { std::lock_guard<std::mutex> guard(sleepLock); }
+        sleepSignal.notify_all();
+    }
+
+    execute({ &current, begin, std::min(begin + chunkSize, end) });
+
+    // Help out with any queued work (including other jobs) until every chunk of this job is done.
+    while (current.remaining.load(std::memory_order_acquire) > 0) {
+        task t;
+        if (findTask(queueIndex, t)) {
+            execute(t);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (current.error) std::rethrow_exception(current.error);
+}
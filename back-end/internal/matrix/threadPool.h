@@ -0,0 +1,109 @@
+#ifndef LIBTHREADPOOL_H
+#define LIBTHREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Process-wide work-stealing thread pool owned by the matrix library. Each worker has its own fixed size
+// task queue, it pops work from the back of its own queue and steals from the front of the other queues
+// once it runs dry. Threads that call parallelFor help execute queued tasks while they wait, so calling
+// parallelFor from inside a parallelFor body is safe and will not deadlock.
+class threadPool {
+
+private:
+    // Type erased loop body, called as body(context, begin, end) for every chunk.
+    typedef void (*loopBody_t)(const void* context, int begin, int end);
+
+    // Shared state of a single parallelFor call. It lives on the stack of the calling thread.
+    struct job {
+        loopBody_t body;
+        const void* context;
+        std::atomic<int> remaining;
+        std::exception_ptr error;
+        std::mutex errorLock;
+    };
+
+    // A chunk [begin, end) of a job.
+    struct task {
+        job* owner;
+        int begin;
+        int end;
+    };
+
+    // Fixed capacity ring buffer of tasks, queues never allocate once the pool is running.
+    static const unsigned int queueCapacity = 256;
+    struct workerQueue {
+        std::mutex lock;
+        task tasks[queueCapacity];
+        unsigned int head = 0;
+        unsigned int size = 0;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<workerQueue>> queues;
+
+    std::atomic<int> pendingTasks{ 0 };
+    std::atomic<int> sleepingWorkers{ 0 };
+    std::atomic<unsigned int> nextQueue{ 0 };
+    bool stopping = false;
+
+    // Times an idle worker yields before it sleeps. Operations issued back to back, like the products of training, find
+    // the worker awake, but every burst also leaves each worker busy yielding for this long once the work runs out.
+    unsigned int spinIterations = 256;
+
+    std::mutex sleepLock;
+    std::condition_variable sleepSignal;
+
+    threadPool();
+
+    void start(unsigned int workerCount);
+
+    void stop();
+
+    void workerLoop(unsigned int index);
+
+    bool push(unsigned int queueIndex, const task& t);
+
+    bool popBack(unsigned int queueIndex, task& t);
+
+    bool stealFront(unsigned int queueIndex, task& t);
+
+    bool findTask(unsigned int firstQueue, task& t);
+
+    void execute(const task& t);
+
+    void run(int begin, int end, int chunkSize, loopBody_t body, const void* context);
+
+public:
+    ~threadPool();
+
+    threadPool(const threadPool&) = delete;
+
+    threadPool& operator=(const threadPool&) = delete;
+
+    static threadPool& getInstance();
+
+    unsigned int getWorkerCount();
+
+    // Number of threads that can work on a parallelFor at once, the workers plus the calling thread.
+    unsigned int getConcurrency();
+
+    void setWorkerCount(unsigned int workerCount);
+
+    // Splits [begin, end) into chunks of chunkSize iterations and calls body(chunkBegin, chunkEnd) for each
+    // chunk on the pool. A chunkSize <= 0 picks a chunk size based on the number of workers. Blocks until every
+    // chunk has finished, the first exception thrown by body is rethrown on the calling thread.
+    template <typename F>
+    void parallelFor(int begin, int end, int chunkSize, const F& body) {
+        run(begin, end, chunkSize, [](const void* context, int chunkBegin, int chunkEnd) {
+            (*static_cast<const F*>(context))(chunkBegin, chunkEnd);
+            }, &body);
+    }
+};
+
+#endif
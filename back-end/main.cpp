@@ -1,129 +1,614 @@
 #include <multilayerPerceptron.cpp>
+#include <modelIO.cpp>
+#include <batchScheduler.cpp>
+#include <jsonPixelParser.cpp>
+#include <modelReloader.cpp>
+#include <metrics.cpp>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <thread>
 #include <App.h>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
 const unsigned short PORT = 8080;
 
-// Helper function for reading and loading weights and biases from text file.
-// Returns W1, W2, W3, B1, B2, B3 matrices if applicable.
-std::tuple<matrix, matrix, std::vector<matrix>, std::vector<matrix>> readFromFile(std::string fileName) {
-    std::vector<twoDimDoubleArray_t> hiddenLayerData;
-    twoDimDoubleArray_t inputWeights, outputBiases, temp;
+void applyCORSHeaders(auto* res) {
+    res->writeHeader("Access-Control-Allow-Origin", "*");
+    res->writeHeader("Access-Control-Allow-Methods", "POST, OPTIONS");
+    res->writeHeader("Access-Control-Allow-Headers", "Content-Type");
+}
 
-    std::ifstream inFile(fileName);
+// Settings of the server, see main for the command line flags that set them.
+struct serverOptions {
+    int maxBatchSize = 16;
+    long maxWaitMicroseconds = 200;
+    int inferenceWorkers = 2;
+    int queueLimit = 1024;
+    int threads = 1;
+    int maxRequestBatchSize = 1024;
+    std::string weightsPath = "../weights/784-392-196-98-49-25-10.txt";
+    long watchMilliseconds = 1000;
+    bool quantized = false;
 
-    if (inFile.is_open()) {
-        std::string line;
-        std::string header;
+    // The token the admin routes require, they are turned off while it is empty.
+    std::string adminToken;
+};
 
-        while (getline(inFile, line)) {
-            // Handle end of hidden layer data
-            if (line.length() == 0 && (header == "hiddenLayerWeights" || header == "hiddenLayerBiases")) {
-                hiddenLayerData.push_back(temp);
-                temp.clear();
-                continue;
-            }
+// Every served model takes a 28 x 28 image and scores the 10 digits.
+const int imageSize = 784;
+const int digits = 10;
+
+// The served model takes pixels as they are, 0 to 255, the division by 255 the model was trained with is folded into its input
+// weights, see MLP::foldInputScale.
+const double pixelScale = 1.0 / 255.0;
+
+// Content type of a body of raw uint8 pixels, one image after the other. Any other content type is parsed as JSON.
+const std::string_view binaryContentType = "application/octet-stream";
 
-            // Skip empty lines
-            if (line.length() == 0) continue;
+// Most images a single binary request may carry.
+const int maxImagesPerRequest = 64;
 
-            // Grab and skip header when it shows up
-            if (line == "inputWeights") { header = "inputWeights"; continue; }
-            else if (line == "hiddenLayerWeights") { header = "hiddenLayerWeights"; continue; }
-            else if (line == "hiddenLayerBiases") { header = "hiddenLayerBiases"; continue; }
-            else if (line == "outputBiases") { header = "outputBiases"; continue; }
+// Body of a /predict request as it arrives, possibly in several chunks. Binary bodies are decoded while they arrive, every byte
+// goes straight into the input of its image, which is then handed to the scheduler as it is. JSON bodies are parsed while they
+// arrive too, see jsonPixelParser. Either throws std::invalid_argument as soon as the body can not be valid.
+template <typename T>
+struct requestBody {
+    bool binary;
+    int inputSize;
 
-            std::stringstream ss(line);
-            std::string value;
-            doubleArray_t row;
+    // JSON pixels are normalized, 0 to 1, the parser scales them to pixels as the served model takes them.
+    jsonPixelParser<T> parser;
 
-            while (getline(ss, value, ' ')) {
-                row.push_back(std::stod(value));
+    std::vector<std::vector<T>> images;
+
+    // Set once the request has been answered with an error, later chunks are ignored.
+    bool rejected = false;
+
+    requestBody(bool binary, int inputSize)
+        : binary(binary), inputSize(inputSize), parser(binary ? 0 : inputSize, 1.0 / pixelScale) {}
+
+    void append(std::string_view chunk) {
+        if (!binary) {
+            parser.consume(chunk);
+            return;
+        }
+
+        const unsigned char* bytes = (const unsigned char*)chunk.data();
+        size_t remaining = chunk.size();
+        while (remaining > 0) {
+            if (images.empty() || (int)images.back().size() == inputSize) {
+                if (images.size() == maxImagesPerRequest) {
+                    throw std::invalid_argument("At most " + std::to_string(maxImagesPerRequest) + " images fit in one request.");
+                }
+                images.emplace_back();
+                images.back().reserve(inputSize);
             }
+            std::vector<T>& image = images.back();
+            size_t count = std::min(remaining, (size_t)inputSize - image.size());
+            image.insert(image.end(), bytes, bytes + count);
+            bytes += count;
+            remaining -= count;
+        }
+    }
 
-            // Add data to correct vector, depending on header.
-            if (header == "inputWeights") inputWeights.push_back(row);
-            else if (header == "hiddenLayerWeights") temp.push_back(row);
-            else if (header == "hiddenLayerBiases") temp.push_back(row);
-            else if (header == "outputBiases") outputBiases.push_back(row);
+    // Returns the inputs of every image of the complete body. Throws std::invalid_argument when the body is incomplete, a
+    // binary body must be a whole number of images.
+    std::vector<std::vector<T>> inputs() {
+        if (!binary) return { parser.finish() };
+
+        if (images.empty() || (int)images.back().size() != inputSize) {
+            throw std::invalid_argument("Expected a multiple of " + std::to_string(inputSize) + " bytes.");
         }
+        return std::move(images);
     }
+};
+
+typedef std::chrono::steady_clock timer;
+
+// Counts a prediction request on the given route as received and in flight, and returns the time it arrived, see finishRequest.
+timer::time_point startRequest(metrics::counter route) {
+    metrics& m = metrics::getInstance();
+    m.count(route);
+    m.count(metrics::started);
+    return timer::now();
+}
 
-    std::vector<matrix> hiddenLayersWeights;
-    std::vector<matrix> hiddenLayersBiases;
-    for (int i = 0; i < hiddenLayerData.size(); i += 2) {
-        hiddenLayersWeights.push_back(hiddenLayerData[i]);
-        hiddenLayersBiases.push_back(hiddenLayerData[i + 1]);
+// Writes the response of a prediction request corked, with send, records how long the write and the whole request took, and
+// counts the request as no longer in flight.
+template <typename F>
+void finishRequest(auto* res, timer::time_point arrival, F send) {
+    auto start = timer::now();
+    res->cork(send);
+    auto end = timer::now();
+
+    metrics& m = metrics::getInstance();
+    m.record(metrics::write, end - start);
+    m.record(metrics::total, end - arrival);
+    m.count(metrics::finished);
+}
+
+// Answers a prediction request whose body was rejected.
+void respondBadRequest(auto* res, timer::time_point arrival, const std::string& error) {
+    metrics::getInstance().count(metrics::badRequests);
+    finishRequest(res, arrival, [res, &error]() {
+        res->writeStatus("400 Bad Request");
+        applyCORSHeaders(res);
+        res->end(error);
+        });
+}
+
+// Checks the X-Admin-Token header of a request to an admin route against the token of the server, and answers 404 when the
+// admin routes are turned off or 401 when the token does not match. Returns whether the request may go on.
+bool authorizeAdmin(auto* res, auto* req, const serverOptions& options) {
+    if (options.adminToken.empty()) {
+        res->writeStatus("404 Not Found");
+        res->end("");
+        return false;
     }
 
-    return std::tuple<matrix, matrix, std::vector<matrix>, std::vector<matrix>>(matrix(inputWeights), matrix(outputBiases), hiddenLayersWeights, hiddenLayersBiases);
+    // Compares every byte whatever the first mismatch, so the time taken does not tell how much of a guess was right.
+    std::string_view token = req->getHeader("x-admin-token");
+    unsigned char difference = token.size() != options.adminToken.size();
+    for (size_t i = 0; i < options.adminToken.size(); i++) {
+        difference |= (i < token.size() ? token[i] : 0) ^ options.adminToken[i];
+    }
+    if (difference != 0) {
+        res->writeStatus("401 Unauthorized");
+        res->end("");
+        return false;
+    }
+    return true;
 }
 
-void applyCORSHeaders(auto* res) {
-    res->writeHeader("Access-Control-Allow-Origin", "*");
-    res->writeHeader("Access-Control-Allow-Methods", "POST, OPTIONS");
-    res->writeHeader("Access-Control-Allow-Headers", "Content-Type");
+// Sets the abort flag of a prediction request once its client is gone, and counts the request as aborted.
+void watchAborts(auto* res, std::shared_ptr<std::atomic<bool>> aborted) {
+    res->onAborted([aborted]() {
+        *aborted = true;
+        metrics& m = metrics::getInstance();
+        m.count(metrics::aborts);
+        m.count(metrics::finished);
+        printf("Stream was aborted!\n");
+        });
+}
+
+// Labels of the images of one request, the response is sent once the last of them is predicted. Only used on the loop of the request.
+struct pendingPrediction {
+    std::vector<int> labels;
+    int remaining = 0;
+    bool overloaded = false;
+    timer::time_point arrival;
+};
+
+// Responds with the label of a single image, or a JSON array with the label of every image of a binary request.
+void respond(auto* res, const pendingPrediction& pending) {
+    bool failed = std::find(pending.labels.begin(), pending.labels.end(), -1) != pending.labels.end();
+    if (pending.overloaded) metrics::getInstance().count(metrics::rejected);
+    else if (failed) metrics::getInstance().count(metrics::failures);
+
+    finishRequest(res, pending.arrival, [res, &pending, failed]() {
+        if (pending.overloaded) res->writeStatus("503 Service Unavailable");
+        else if (failed) res->writeStatus("500 Internal Server Error");
+        applyCORSHeaders(res);
+        if (pending.overloaded || failed) res->end("");
+        else if (pending.labels.size() == 1) res->end(std::to_string(pending.labels[0]));
+        else res->end(json(pending.labels).dump());
+        });
 }
 
-// Parses request body
-matrix parseBody(std::string_view body) {
-    json j = json::parse(body);
-    doubleArray_t data;
-    for (auto& x : j.items()) {
-        data.push_back(x.value());
+// Submits every image of a request to the scheduler, the last prediction to finish sends the response.
+template <typename T>
+void predict(auto* res, batchScheduler<T>& scheduler, std::vector<std::vector<T>> images, std::shared_ptr<std::atomic<bool>> aborted,
+    timer::time_point arrival) {
+    auto pending = std::make_shared<pendingPrediction>();
+    pending->arrival = arrival;
+    int count = images.size();
+    pending->labels.assign(count, -1);
+    pending->remaining = count;
+
+    for (int i = 0; i < count; i++) {
+        bool queued = scheduler.submit(std::move(images[i]), [res, aborted, pending, i](typename batchScheduler<T>::classification result) {
+            pending->labels[i] = result.label;
+            if (--pending->remaining == 0 && !*aborted) respond(res, *pending);
+            }, aborted);
+        if (!queued) {
+            // The images already queued still run, the response waits for them.
+            pending->overloaded = true;
+            pending->remaining -= count - i;
+            if (pending->remaining == 0) respond(res, *pending);
+            return;
+        }
     }
-    return matrix(data, data.size(), 1);
 }
 
-// Parsed predicton given by neural network
-int parsePrediction(matrix prediction) {
-    int returnVal = -1;
-    double confidence = 0.0;
-    for (int i = 0; i < prediction.getRows(); i++) {
-        if (prediction(i, 0) > confidence) {
-            confidence = prediction(i, 0);
-            returnVal = i;
+// Body of a /predict/batch request, several images in one buffer with a row per image, ready to be the input matrix of a
+// single forward pass. Binary bodies are the bytes of one image after the other, JSON bodies an array with an array of normalized
+// pixels per image. Throws std::invalid_argument as soon as the body can not be valid.
+template <typename T>
+struct batchRequestBody {
+    bool binary;
+    int inputSize;
+    int maxImages;
+    jsonPixelParser<T> parser;
+    std::vector<T> pixels;
+    bool rejected = false;
+
+    // contentLength is the announced size of the body, used to allocate a binary body once. It comes straight from the client,
+    // so it is clamped to the largest body a request may have, a missing or negative one allocates nothing up front.
+    batchRequestBody(bool binary, int inputSize, int maxImages, long contentLength)
+        : binary(binary), inputSize(inputSize), maxImages(maxImages), parser(inputSize, binary ? 0 : maxImages, 1.0 / pixelScale) {
+        if (binary) pixels.reserve(std::clamp(contentLength, 0L, (long)maxImages * inputSize));
+    }
+
+    void append(std::string_view chunk) {
+        if (!binary) {
+            parser.consume(chunk);
+            return;
+        }
+
+        if (pixels.size() + chunk.size() > (size_t)maxImages * inputSize) {
+            throw std::invalid_argument("At most " + std::to_string(maxImages) + " images fit in one request.");
         }
+        pixels.insert(pixels.end(), (const unsigned char*)chunk.data(), (const unsigned char*)chunk.data() + chunk.size());
     }
-    return returnVal;
+
+    // Returns the pixels of every image of the complete body. Throws std::invalid_argument when the body is incomplete.
+    std::vector<T> inputs() {
+        if (!binary) return parser.finish();
+
+        if (pixels.empty() || pixels.size() % inputSize != 0) {
+            throw std::invalid_argument("Expected a multiple of " + std::to_string(inputSize) + " bytes.");
+        }
+        return std::move(pixels);
+    }
+};
+
+// State of a WebSocket prediction stream. At most one image of a stream is predicted at a time. An image that arrives meanwhile
+// waits in latest and replaces any image waiting there before it, so a client that draws faster than the model runs always gets
+// the prediction of its newest drawing next. Only used on the loop of the connection.
+template <typename T>
+struct streamState {
+    // Set once the connection is closed, the socket must not be used from then on. It also cancels a queued prediction.
+    std::shared_ptr<std::atomic<bool>> closed;
+
+    std::vector<T> latest;
+    bool waiting = false;
+    bool predicting = false;
+
+    // Number of images the client has sent, the sequence number of the image in latest.
+    long received = 0;
+};
+
+// Reads the pixels of a stream message into latest: 784 bytes of raw pixels in a binary message, or a JSON array of normalized
+// pixels in a text message. Throws std::invalid_argument when the message is not an image.
+template <typename T>
+void readStreamImage(std::string_view message, bool binary, int inputSize, std::vector<T>& latest) {
+    if (!binary) {
+        jsonPixelParser<T> parser(inputSize, 1.0 / pixelScale);
+        parser.consume(message);
+        latest = parser.finish();
+        return;
+    }
+
+    if ((int)message.size() != inputSize) throw std::invalid_argument("Expected " + std::to_string(inputSize) + " bytes.");
+    latest.assign((const unsigned char*)message.data(), (const unsigned char*)message.data() + message.size());
 }
 
-int main() {
-    // Initialize model
-    MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 25});
+// Submits the waiting image of a stream. Its prediction is sent back as {"sequence": n, "label": l, "confidence": c}, where n is
+// the number of images the client had sent up to this one, then the image that arrived meanwhile, if any, is submitted.
+template <typename T>
+void predictStream(auto* ws, batchScheduler<T>& scheduler) {
+    streamState<T>* state = ws->getUserData();
+    state->waiting = false;
+    state->predicting = true;
 
-    // Read in weights and biases from text file
-    auto [inputWeights, outputBiases, hiddenLayersWeights, hiddenLayersBiases] = readFromFile("../weights/784-392-196-98-49-25-10.txt");
-    model.setWeights(inputWeights, hiddenLayersWeights);
-    model.setBiases(outputBiases, hiddenLayersBiases);
+    long sequence = state->received;
+    std::shared_ptr<std::atomic<bool>> closed = state->closed;
+    auto sendResult = [ws, &scheduler, closed, sequence](typename batchScheduler<T>::classification result) {
+        if (*closed) return;
+
+        json message = { { "sequence", sequence } };
+        if (result.label < 0) message["error"] = "The prediction failed.";
+        else {
+            message["label"] = result.label;
+            message["confidence"] = result.confidence;
+        }
+        ws->send(message.dump(), uWS::OpCode::TEXT);
+
+        streamState<T>* state = ws->getUserData();
+        state->predicting = false;
+        if (state->waiting) predictStream<T>(ws, scheduler);
+    };
 
-    // Initialize web-server
+    if (!scheduler.submit(std::move(state->latest), sendResult, closed)) {
+        state->predicting = false;
+        ws->send(json({ { "sequence", sequence }, { "error", "The server is overloaded." } }).dump(), uWS::OpCode::TEXT);
+    }
+}
+
+// Runs one event loop with its own App until the server is shut down. Every loop listens on PORT, SO_REUSEPORT lets the kernel
+// spread the connections across them. Requests are parsed on the loop and predicted in batches by the workers of the scheduler,
+// which hand the labels back to the loop that submitted them. The loop never runs the model.
+template <typename T>
+void runEventLoop(batchScheduler<T>& scheduler, modelReloader<T>& reloader, const serverOptions& options, int inputSize, int thread) {
     uWS::App().options("/predict", [](auto* res, auto* req) {
         applyCORSHeaders(res);
         res->end("");
         })
-        .post("/predict", [&model](auto* res, auto* req) {
-            applyCORSHeaders(res);
-            res->onData([res, &model](std::string_view body, bool isLast) {
-                if (isLast) {
-                    auto [hiddenAs, lastA] = model.prediction(parseBody(body));
-                    res->end(std::to_string(parsePrediction(lastA)));
+        .post("/predict", [&scheduler, inputSize](auto* res, auto* req) {
+            timer::time_point arrival = startRequest(metrics::predictRequests);
+
+            // The response must not be touched once the client is gone, the prediction may still be in flight by then. The flag is
+            // also read by the workers, which drop the request if it has not run yet.
+            auto aborted = std::make_shared<std::atomic<bool>>(false);
+            watchAborts(res, aborted);
+
+            // The request and its headers are only valid until this handler returns.
+            bool binary = req->getHeader("content-type").substr(0, binaryContentType.size()) == binaryContentType;
+
+            // Receiving spans the whole body, parsing only the time spent decoding its chunks.
+            res->onData([res, &scheduler, aborted, arrival, parseTime = timer::duration(), body = requestBody<T>(binary, inputSize)]
+            (std::string_view chunk, bool isLast) mutable {
+                if (body.rejected) return;
+
+                auto start = timer::now();
+                try {
+                    body.append(chunk);
+                    if (!isLast) {
+                        parseTime += timer::now() - start;
+                        return;
+                    }
+
+                    std::vector<std::vector<T>> images = body.inputs();
+                    metrics::getInstance().record(metrics::parse, parseTime + (timer::now() - start));
+                    metrics::getInstance().record(metrics::receive, start - arrival);
+                    predict(res, scheduler, std::move(images), aborted, arrival);
+                }
+                catch (const std::exception& e) {
+                    body.rejected = true;
+                    respondBadRequest(res, arrival, e.what());
                 }
                 });
-            res->onAborted([]() {
-                printf("Stream was aborted!\n");
+            })
+        .options("/predict/batch", [](auto* res, auto* req) {
+            applyCORSHeaders(res);
+            res->end("");
+            })
+        .post("/predict/batch", [&scheduler, &options, inputSize](auto* res, auto* req) {
+            timer::time_point arrival = startRequest(metrics::batchRequests);
+            auto aborted = std::make_shared<std::atomic<bool>>(false);
+            watchAborts(res, aborted);
+
+            bool binary = req->getHeader("content-type").substr(0, binaryContentType.size()) == binaryContentType;
+            bool confidences = req->getQuery("confidences") == "true";
+            long contentLength = std::atol(std::string(req->getHeader("content-length")).c_str());
+            auto body = batchRequestBody<T>(binary, inputSize, options.maxRequestBatchSize, contentLength);
+
+            res->onData([res, &scheduler, aborted, arrival, confidences, parseTime = timer::duration(), body = std::move(body)]
+            (std::string_view chunk, bool isLast) mutable {
+                if (body.rejected) return;
+
+                auto start = timer::now();
+                try {
+                    body.append(chunk);
+                    if (!isLast) {
+                        parseTime += timer::now() - start;
+                        return;
+                    }
+
+                    std::vector<T> images = body.inputs();
+                    metrics::getInstance().record(metrics::parse, parseTime + (timer::now() - start));
+                    metrics::getInstance().record(metrics::receive, start - arrival);
+
+                    auto respondBatch = [res, aborted, arrival, confidences](std::vector<typename batchScheduler<T>::classification> results) {
+                        if (*aborted) return;
+                        if (results.empty()) metrics::getInstance().count(metrics::failures);
+
+                        finishRequest(res, arrival, [res, confidences, &results]() {
+                            if (results.empty()) res->writeStatus("500 Internal Server Error");
+                            applyCORSHeaders(res);
+                            if (results.empty()) {
+                                res->end("");
+                                return;
+                            }
+
+                            json response;
+                            for (const auto& result : results) {
+                                response["labels"].push_back(result.label);
+                                if (confidences) response["confidences"].push_back(result.confidence);
+                            }
+                            res->writeHeader("Content-Type", "application/json");
+                            res->end(response.dump());
+                            });
+                        };
+                    if (!scheduler.submitBatch(std::move(images), respondBatch, aborted)) {
+                        metrics::getInstance().count(metrics::rejected);
+                        finishRequest(res, arrival, [res]() {
+                            res->writeStatus("503 Service Unavailable");
+                            applyCORSHeaders(res);
+                            res->end("");
+                            });
+                    }
+                }
+                catch (const std::exception& e) {
+                    body.rejected = true;
+                    respondBadRequest(res, arrival, e.what());
+                }
                 });
             })
-            .listen(PORT, [](auto* listenSocket) {
+        .template ws<streamState<T>>("/stream", {
+            .maxPayloadLength = 64 * 1024,
+            .idleTimeout = 120,
+            .maxBackpressure = 64 * 1024,
+            .open = [](auto* ws) {
+                ws->getUserData()->closed = std::make_shared<std::atomic<bool>>(false);
+                metrics::getInstance().count(metrics::streamsOpened);
+            },
+            .message = [&scheduler, inputSize](auto* ws, std::string_view message, uWS::OpCode opCode) {
+                streamState<T>* state = ws->getUserData();
+                metrics::getInstance().count(metrics::streamUpdates);
+                try {
+                    readStreamImage<T>(message, opCode == uWS::OpCode::BINARY, inputSize, state->latest);
+                }
+                catch (const std::exception& e) {
+                    ws->send(json({ { "error", e.what() } }).dump(), uWS::OpCode::TEXT);
+                    return;
+                }
+
+                state->received++;
+                if (state->waiting) metrics::getInstance().count(metrics::coalescedUpdates);
+                state->waiting = true;
+                if (!state->predicting) predictStream<T>(ws, scheduler);
+            },
+            .close = [](auto* ws, int code, std::string_view message) {
+                *ws->getUserData()->closed = true;
+                metrics::getInstance().count(metrics::streamsClosed);
+            }
+            })
+        .post("/admin/reload", [&reloader, &options](auto* res, auto* req) {
+            if (!authorizeAdmin(res, req, options)) return;
+
+            // The reload runs on the thread of the reloader, GET /admin/model tells when it is done.
+            reloader.reload();
+            res->writeStatus("202 Accepted");
+            res->writeHeader("Content-Type", "application/json");
+            res->end(reloader.status());
+            })
+        .get("/admin/model", [&reloader, &options](auto* res, auto* req) {
+            if (!authorizeAdmin(res, req, options)) return;
+
+            res->writeHeader("Content-Type", "application/json");
+            res->end(reloader.status());
+            })
+        .get("/metrics", [](auto* res, auto* req) {
+            metrics::getInstance().count(metrics::otherRequests);
+            res->writeHeader("Content-Type", "text/plain; version=0.0.4");
+            res->end(metrics::getInstance().prometheus());
+            })
+        .get("/stats", [&scheduler](auto* res, auto* req) {
+            res->writeHeader("Content-Type", "application/json");
+            res->end(scheduler.statistics());
+            })
+            .listen(PORT, LIBUS_LISTEN_DEFAULT, [thread](auto* listenSocket) {
                 if (listenSocket) {
-                    std::cout << "Listening to port: " << PORT << std::endl;
+                    std::cout << "Thread " << thread << " listening to port: " << PORT << std::endl;
                 }
                 })
                 .run();
 
-                std::cout << "Failed to listen on given port, exiting now..." << std::endl;
-                return 0;
-}
\ No newline at end of file
+                std::cout << "Thread " << thread << " failed to listen on given port, exiting now..." << std::endl;
+}
+
+// Reads a weights file into a model ready to serve. The hidden layers are taken from the file, the pixel normalization is folded into
+// the input weights, and the weights are converted to T and quantized when asked. Throws std::invalid_argument when the file does
+// not hold a network with imageSize inputs and digits outputs whose layers fit together.
+template <typename T>
+std::shared_ptr<const MLP<T>> loadModel(const std::string& path, bool quantized) {
+    if (!std::ifstream(path).good()) throw std::invalid_argument("Can not read " + path + ".");
+
+    auto [inputWeights, outputBiases, hiddenLayersWeights, hiddenLayersBiases] = readFromFile(path);
+    if (hiddenLayersWeights.empty() || hiddenLayersWeights.size() != hiddenLayersBiases.size()) {
+        throw std::invalid_argument("Every hidden layer needs weights and biases.");
+    }
+
+    // Layer 0 maps the inputs to the first hidden layer, hidden layer i maps layer i to layer i + 1.
+    std::vector<int> hiddenSizes;
+    int inputs = imageSize;
+    for (int layer = 0; layer <= hiddenLayersWeights.size(); layer++) {
+        const matrix& weights = layer == 0 ? inputWeights : hiddenLayersWeights[layer - 1];
+        const matrix& biases = layer == hiddenLayersWeights.size() ? outputBiases : hiddenLayersBiases[layer];
+        if (weights.getColumns() != inputs || biases.getRows() != weights.getRows() || biases.getColumns() != 1) {
+            throw std::invalid_argument("The weights and biases of layer " + std::to_string(layer) + " do not fit together.");
+        }
+        inputs = weights.getRows();
+        if (layer < hiddenLayersWeights.size()) hiddenSizes.push_back(inputs);
+    }
+    if (inputs != digits) throw std::invalid_argument("The last layer must have " + std::to_string(digits) + " outputs.");
+
+    MLP model = MLP(imageSize, digits, hiddenSizes);
+    model.setWeights(inputWeights, hiddenLayersWeights);
+    model.setBiases(outputBiases, hiddenLayersBiases);
+    model.foldInputScale(pixelScale);
+
+    auto served = std::make_shared<MLP<T>>(model);
+    if (quantized) served->quantize();
+    return served;
+}
+
+// Serves predictions on options.threads event loops until the server is shut down. The loops share the scheduler and through it
+// the model, which is only ever read so its weights exist once however many loops there are. The model is reloaded from its file
+// when that changes or on POST /admin/reload.
+template <typename T>
+int serve(const serverOptions& options) {
+    if (options.threads < 1) throw std::invalid_argument("There must be at least one event loop thread.");
+
+    auto load = [quantized = options.quantized](const std::string& path) { return loadModel<T>(path, quantized); };
+    std::shared_ptr<const MLP<T>> model = load(options.weightsPath);
+    int inputSize = model->getInputSize();
+
+    batchScheduler<T> scheduler(model, options.maxBatchSize, options.maxWaitMicroseconds, options.inferenceWorkers, options.queueLimit);
+    modelReloader<T> reloader(scheduler, options.weightsPath, load, options.watchMilliseconds);
+
+    std::vector<std::thread> loops;
+    for (int t = 1; t < options.threads; t++) {
+        loops.push_back(std::thread([&scheduler, &reloader, &options, inputSize, t]() { runEventLoop(scheduler, reloader, options, inputSize, t); }));
+    }
+    runEventLoop(scheduler, reloader, options, inputSize, 0);
+
+    for (std::thread& loop : loops) {
+        loop.join();
+    }
+    return 0;
+}
+
+// Pass --float to serve the model with float weights, or --int8 to serve it with int8 weights and float
+// activations. See evaluate/ for how far their predictions drift.
+// --batch-size n and --batch-wait-us t bound the batches of /predict requests, a batch runs once it holds n requests or its oldest
+// request has waited t microseconds. A batch size of 1 turns batching off. --workers n sets the number of threads running batches,
+// and --queue-limit n the number of requests that may wait for one before the server answers 503. GET /stats reports the batch
+// sizes and wait times. --threads n serves HTTP on n event loops, one per thread, all on the same port.
+// POST /predict takes a JSON array of 784 pixels between 0 and 1 and answers with the label. With a Content-Type of
+// application/octet-stream it takes 784 bytes per image instead, pixels between 0 and 255, and answers with the label of a single
+// image or a JSON array of the labels of several. POST /predict/batch takes up to --max-request-batch n images, 1024 by default, as
+// a JSON array of such arrays or as bytes, runs them as one forward pass, and answers with {"labels": [...]}, plus "confidences"
+// when called with ?confidences=true.
+// --weights path sets the weights file, which is checked for changes every --watch-ms t milliseconds, 1000 by default and 0 to not
+// watch it, and reloaded without stopping the server. POST /admin/reload reloads it on demand, GET /admin/model reports the model
+// version, how long the last reload took, and the error of the last failed one. Both share the public port with /predict, so they
+// are off by default, answering 404, and --admin-token t turns them on for requests that carry t in an X-Admin-Token header.
+// GET /metrics exports request counts, aborts, errors, in flight requests, and latency
+// histograms of every stage of a prediction in the Prometheus text format.
+// The WebSocket route /stream takes one image per message, 784 bytes in a binary message or a JSON array in a text message, and
+// answers each with {"sequence": n, "label": l, "confidence": c}. Images sent while the previous one is predicted are coalesced,
+// only the newest is predicted next.
+int main(int argc, char** argv) {
+    std::string mode;
+    serverOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--float" || arg == "--int8") mode = arg;
+        else if (arg == "--batch-size" && i + 1 < argc) options.maxBatchSize = std::stoi(argv[++i]);
+        else if (arg == "--batch-wait-us" && i + 1 < argc) options.maxWaitMicroseconds = std::stol(argv[++i]);
+        else if (arg == "--workers" && i + 1 < argc) options.inferenceWorkers = std::stoi(argv[++i]);
+        else if (arg == "--queue-limit" && i + 1 < argc) options.queueLimit = std::stoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) options.threads = std::stoi(argv[++i]);
+        else if (arg == "--max-request-batch" && i + 1 < argc) options.maxRequestBatchSize = std::stoi(argv[++i]);
+        else if (arg == "--weights" && i + 1 < argc) options.weightsPath = argv[++i];
+        else if (arg == "--watch-ms" && i + 1 < argc) options.watchMilliseconds = std::stol(argv[++i]);
+        else if (arg == "--admin-token" && i + 1 < argc) options.adminToken = argv[++i];
+        else {
+            std::cout << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (mode == "--float" || mode == "--int8") {
+        options.quantized = mode == "--int8";
+        std::cout << "Serving " << (mode == "--int8" ? "int8" : "float") << " weights." << std::endl;
+        return serve<float>(options);
+    }
+
+    return serve<double>(options);
+}
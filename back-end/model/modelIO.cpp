@@ -0,0 +1,62 @@
+#include <matrix.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Helper function for reading and loading weights and biases from text file.
+// Returns W1, W2, W3, B1, B2, B3 matrices if applicable.
+std::tuple<matrix, matrix, std::vector<matrix>, std::vector<matrix>> readFromFile(std::string fileName) {
+    std::vector<twoDimDoubleArray_t> hiddenLayerData;
+    twoDimDoubleArray_t inputWeights, outputBiases, temp;
+
+    std::ifstream inFile(fileName);
+
+    if (inFile.is_open()) {
+        std::string line;
+        std::string header;
+
+        while (getline(inFile, line)) {
+            // Handle end of hidden layer data
+            if (line.length() == 0 && (header == "hiddenLayerWeights" || header == "hiddenLayerBiases")) {
+                hiddenLayerData.push_back(temp);
+                temp.clear();
+                continue;
+            }
+
+            // Skip empty lines
+            if (line.length() == 0) continue;
+
+            // Grab and skip header when it shows up
+            if (line == "inputWeights") { header = "inputWeights"; continue; }
+            else if (line == "hiddenLayerWeights") { header = "hiddenLayerWeights"; continue; }
+            else if (line == "hiddenLayerBiases") { header = "hiddenLayerBiases"; continue; }
+            else if (line == "outputBiases") { header = "outputBiases"; continue; }
+
+            std::stringstream ss(line);
+            std::string value;
+            doubleArray_t row;
+
+            while (getline(ss, value, ' ')) {
+                row.push_back(std::stod(value));
+            }
+
+            // Add data to correct vector, depending on header.
+            if (header == "inputWeights") inputWeights.push_back(row);
+            else if (header == "hiddenLayerWeights") temp.push_back(row);
+            else if (header == "hiddenLayerBiases") temp.push_back(row);
+            else if (header == "outputBiases") outputBiases.push_back(row);
+        }
+    }
+
+    if (hiddenLayerData.size() % 2 != 0) throw std::invalid_argument("Every hidden layer needs weights and biases.");
+
+    std::vector<matrix> hiddenLayersWeights;
+    std::vector<matrix> hiddenLayersBiases;
+    for (int i = 0; i < hiddenLayerData.size(); i += 2) {
+        hiddenLayersWeights.push_back(hiddenLayerData[i]);
+        hiddenLayersBiases.push_back(hiddenLayerData[i + 1]);
+    }
+
+    return std::tuple<matrix, matrix, std::vector<matrix>, std::vector<matrix>>(matrix(inputWeights), matrix(outputBiases), hiddenLayersWeights, hiddenLayersBiases);
+}
@@ -1,36 +1,306 @@
+#ifndef MULTILAYERPERCEPTRON_CPP
+#define MULTILAYERPERCEPTRON_CPP
+
 #include <matrix.h>
+#include <quantizedMatrix.h>
+#include <sparseMatrix.h>
+#include <threadPool.h>
 #include <algorithm>
+#include <chrono>
 #include <random>
 
 // Represents a hidden layer in a multilayer perceptron, consists of weights and biases.
+template <typename T = double>
 struct hiddenLayer {
-    matrix weights;
-    matrix biases;
-    hiddenLayer(matrix weights, matrix biases): weights(weights), biases(biases) {}
+    basicMatrix<T> weights;
+    basicMatrix<T> biases;
+    hiddenLayer(basicMatrix<T> weights, basicMatrix<T> biases): weights(std::move(weights)), biases(std::move(biases)) {}
 };
 
 // This represents a multilayer perceptron. It must have one input layer, one output layer,
-// and an arbitrary number of hidden layers.
+// and an arbitrary number of hidden layers. T is the element type of the weights and activations,
+// MLP<float> halves the memory traffic of inference compared to the default MLP<double>.
+template <typename T = double>
 class MLP {
+    template <typename U>
+    friend class MLP;
+
+public:
+    // Inside the model matrix, matrixView, and array_t use the element type of the model.
+    typedef basicMatrix<T> matrix;
+    typedef basicMatrixView<T> matrixView;
+    typedef std::vector<T> array_t;
+
+    // Preallocated buffers for back propagating a batch of up to a fixed number of examples, indexed by layer like
+    // layerWeights and layerBiases. Every matrix is allocated for the largest batch up front and smaller batches reuse
+    // its storage, so training does not allocate once a workspace exists. See createWorkspace.
+    struct workspace {
+        std::vector<matrix> activations;
+        std::vector<matrix> partialDerivatives;
+        std::vector<matrix> weightGradients;
+        std::vector<matrix> biasGradients;
+        matrix labels;
+        matrix ones;
+        double loss;
+
+        // The inputs of the batch as a sparse matrix, when they are sparse enough, see sparseUpdateDensity. sparseGradient is set
+        // when the gradient of the input weights was left out of weightGradients, to be applied from them instead.
+        sparseMatrix<T> sparseInputs;
+        bool sparseGradient = false;
+    };
+
+    // Two buffers that inference alternates between, each sized for the activations of the widest layer. Layer l
+    // reads the activations of layer l - 1 from one buffer and writes its own into the other, so no hidden
+    // activation outlives the layer that reads it. See createInferenceBuffers and infer.
+    struct inferenceBuffers {
+        matrix front;
+        matrix back;
+
+        // When set, infer stores the time each layer took, in nanoseconds, in layerNanoseconds.
+        bool timeLayers = false;
+        std::vector<long> layerNanoseconds;
+
+        // The inputs as a sparse matrix, when they are sparse enough, see sparseProductDensity.
+        sparseMatrix<T> sparseInputs;
+    };
+
+    // State of an incremental inference session over a single column of inputs, see createSession and updateSession. It keeps
+    // the inputs and the pre-activations of the first layer, W * inputs + b, so changing a few inputs only costs a column of
+    // the first layer each.
+    struct inferenceSession {
+        array_t inputs;
+        array_t preActivations;
+        array_t activations;
+        inferenceBuffers buffers;
+
+        // The inputs that changed in an update and by how much.
+        std::vector<std::pair<int, T>> deltas;
+
+        // Updates since the pre-activations were last computed in full, they drift by rounding with every update.
+        int updates;
+    };
+
+    // A new value of the input with the given index.
+    struct inputChange {
+        int index;
+        T value;
+    };
+
+    // The digit a single prediction picks, the index of its largest output, and that output.
+    struct classification {
+        int label;
+        T confidence;
+    };
+
 private:
     matrix inputWeights;
     matrix outputBiases;
-    std::vector<hiddenLayer> hiddenLayers;
+    std::vector<hiddenLayer<T>> hiddenLayers;
+
+    // Int8 copies of the input weights and every hidden layer's weights, in that order. When present,
+    // prediction uses them instead of the full precision weights.
+    std::vector<quantizedMatrix> quantizedWeights;
+
+    // Largest fraction of non-zero inputs for which the first layer only reads the input weights of the non-zero inputs, see
+    // sparseMatrix, in the product and in the weight update of training. Denser inputs go through the dense kernels. Only single
+    // columns of inputs are considered, against a batch the packed matrix-matrix kernels win at any density a digit has. The
+    // thresholds are where the two break even in benchmark/sparseLatency.cpp. A row of float weights spans half as many cache
+    // lines as one of doubles, so the same inputs touch more of them, and a drawn digit, with about a fifth of its pixels set,
+    // only takes the sparse product with double weights.
+    inline static const double sparseProductDensity = sizeof(T) == sizeof(float) ? 0.08 : 0.3;
+    inline static const double sparseUpdateDensity = sizeof(T) == sizeof(float) ? 0.4 : 0.5;
+
+    // Largest fraction of changed inputs for which updateSession updates the first layer by the changed columns rather than
+    // recomputing it. Measured with benchmark/incrementalLatency.cpp, strokes of changed pixels stay faster to apply than a
+    // full infer up to about 60 pixels with float weights, and beyond 300 with double weights, for the same cache line
+    // reason as sparseProductDensity.
+    inline static const double incrementalDensity = sizeof(T) == sizeof(float) ? 0.075 : 0.4;
+
+    // Compresses a single column of inputs into sparseInputs when at most maxDensity of them are non-zero.
+    static bool compressInputs(const matrixView& inputs, sparseMatrix<T>& sparseInputs, double maxDensity) {
+        return inputs.getColumns() == 1 && sparseInputs.compress(inputs, maxDensity);
+    }
+
+    // Layer 0 maps the inputs to the first hidden layer, the last layer maps the last hidden layer to the outputs.
+    int layerCount() const {
+        return hiddenLayers.size() + 1;
+    }
+
+    // Weights of the given layer, the input weights for layer 0 and the weights of hidden layer i - 1 for layer i.
+    matrix& layerWeights(int layer) {
+        return layer == 0 ? inputWeights : hiddenLayers[layer - 1].weights;
+    }
+
+    const matrix& layerWeights(int layer) const {
+        return layer == 0 ? inputWeights : hiddenLayers[layer - 1].weights;
+    }
+
+    // Biases of the given layer, the biases of hidden layer i for layer i and the output biases for the last layer.
+    matrix& layerBiases(int layer) {
+        return layer == hiddenLayers.size() ? outputBiases : hiddenLayers[layer].biases;
+    }
+
+    const matrix& layerBiases(int layer) const {
+        return layer == hiddenLayers.size() ? outputBiases : hiddenLayers[layer].biases;
+    }
 
-    // Dot product between weights and inputs. Biases added after.
-    matrix summation(matrix weights, matrix inputs, matrix biases) {
-        return matrix::matrixMultiply(weights, inputs) + biases;
+    // Dot product between weights and inputs. Biases added after, to every column when the inputs are a batch.
+    matrix summation(const matrix& weights, const matrixView& inputs, const matrix& biases) const {
+        return matrix::matrixMultiplyAdd(weights, inputs, biases);
+    }
+
+    // Weighted summation of the given layer. Uses the quantized weights in quantized mode.
+    matrix summation(int layer, const matrixView& inputs) const {
+        if (!quantizedWeights.empty()) return quantizedWeights[layer].multiplyAdd<T>(inputs, layerBiases(layer));
+
+        return summation(layerWeights(layer), inputs, layerBiases(layer));
+    }
+
+    // Activations of the given layer, sigmoid(W * inputs + b). With full precision weights the product, the biases,
+    // and the sigmoid are fused into one pass, see matrix::matrixMultiplyAddSigmoid.
+    matrix layerActivation(int layer, const matrixView& inputs) const {
+        if (!quantizedWeights.empty()) return sigmoid(summation(layer, inputs));
+
+        sparseMatrix<T> sparseInputs;
+        if (layer == 0 && compressInputs(inputs, sparseInputs, sparseProductDensity)) {
+            matrix result;
+            sparseInputs.multiplyAdd(inputWeights, layerBiases(0), result);
+            return sigmoid(std::move(result));
+        }
+
+        return matrix::matrixMultiplyAddSigmoid(layerWeights(layer), inputs, layerBiases(layer));
     }
 
     // Applies the sigmoid function to every entry of the given matrix.
     // The input matrix is a weighted summation of the inputs plus biases of some arbitrary layer L.
-    matrix sigmoid(matrix weightedSummation) {
-        return matrix::map(weightedSummation, [](double x) { return 1.0 / (1 + std::exp(-x)); });
+    // The result is evaluated in place, reusing the storage of the summation.
+    matrix sigmoid(matrix weightedSummation) const {
+        matrix::map(weightedSummation, activation::sigmoidFunction(), weightedSummation);
+        return weightedSummation;
+    }
+
+    // Runs the layers from firstLayer on, I being the inputs of firstLayer, see infer.
+    const matrix& forward(int firstLayer, const matrixView& I, inferenceBuffers& buffers) const {
+        matrix* in = &buffers.back;
+        matrix* out = &buffers.front;
+
+        if (buffers.timeLayers) buffers.layerNanoseconds.resize(layerCount());
+
+        for (int layer = firstLayer; layer < layerCount(); layer++) {
+            auto start = buffers.timeLayers ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            matrixView layerInputs = layer == firstLayer ? I : matrixView(*in);
+            if (!quantizedWeights.empty()) {
+                quantizedWeights[layer].multiplyAdd<T>(layerInputs, layerBiases(layer), *out);
+                matrix::map(*out, activation::sigmoidFunction(), *out);
+            }
+            else if (layer == 0 && compressInputs(layerInputs, buffers.sparseInputs, sparseProductDensity)) {
+                buffers.sparseInputs.multiplyAdd(inputWeights, layerBiases(0), *out);
+                matrix::map(*out, activation::sigmoidFunction(), *out);
+            }
+            else {
+                matrix::matrixMultiplyAddSigmoid(layerWeights(layer), layerInputs, layerBiases(layer), *out);
+            }
+            std::swap(in, out);
+
+            if (buffers.timeLayers) {
+                buffers.layerNanoseconds[layer] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+
+        return *in;
+    }
+
+    // Computes the pre-activations and activations of the first layer of a session in full from its inputs.
+    void recomputeSession(inferenceSession& session) const {
+        matrixView inputs = matrixView(session.inputs.data(), session.inputs.size(), 1, 1, 1);
+        matrix::matrixMultiplyAdd(inputWeights, inputs, layerBiases(0), session.buffers.front);
+
+        const T* preActivations = session.buffers.front.getData().data();
+        std::copy(preActivations, preActivations + session.preActivations.size(), session.preActivations.begin());
+        activation::sigmoid(session.preActivations.data(), session.activations.data(), session.activations.size());
+        session.updates = 0;
+    }
+
+    // Calculates the average squared error from the differences between the predictions and the labels.
+    // For a batch this is the sum of the errors of its examples.
+    double cost(const matrix& errors) const {
+        return matrix::mapSum(errors, activation::squareFunction()) / errors.getRows();
+    }
+
+    // Forward propagates a batch of inputs, one example per column, and back propagates the error against the labels,
+    // a block of rows of the label matrix. Leaves the gradients summed over the batch and the summed cost in the
+    // workspace. Only reads the model, so shards of a batch can be back propagated on several threads at once.
+    //
+    // Sparse inputs, see sparseProductDensity, only read the input weights of their non-zero inputs. With sparseGradient set,
+    // the gradient of the input weights of sparse inputs is not computed either, it only has non-zero columns for the non-zero
+    // inputs and applyGradients applies it straight from the inputs as an outer product. Shards whose gradients are summed
+    // need it in weightGradients.
+    void backpropagate(const matrixView& inputs, const matrixView& labels, workspace& ws, bool sparseGradient = false) const {
+        int layers = layerCount();
+        bool sparse = compressInputs(inputs, ws.sparseInputs, sparseGradient ? sparseUpdateDensity : sparseProductDensity);
+        ws.sparseGradient = sparse && sparseGradient;
+        sparse = sparse && ws.sparseInputs.getEntries() <= sparseProductDensity * inputs.getRows();
+
+        // ---------- Forward propagation ----------
+        if (sparse) {
+            ws.sparseInputs.multiplyAdd(inputWeights, layerBiases(0), ws.activations[0]);
+            matrix::map(ws.activations[0], activation::sigmoidFunction(), ws.activations[0]);
+        }
+        for (int layer = sparse ? 1 : 0; layer < layers; layer++) {
+            matrixView layerInputs = layer == 0 ? inputs : matrixView(ws.activations[layer - 1]);
+            matrix::matrixMultiplyAddSigmoid(layerWeights(layer), layerInputs, layerBiases(layer), ws.activations[layer]);
+        }
+
+        // ---------- Calculate error/loss ----------
+        const matrix& lastA = ws.activations.back();
+        matrix& lastPD = ws.partialDerivatives.back();
+        matrix::transpose(labels, ws.labels);
+        lastPD = lastA - ws.labels;
+        ws.loss = cost(lastPD);
+
+        // ---------- Back propagation ----------
+        matrixView ones = matrix::getBlockView(ws.ones, 0, 0, inputs.getColumns(), 1);
+        lastPD = matrix::scalarMultiply(lastPD, 2.0) * (lastA * (matrix::map(lastA, activation::oneMinusFunction())));
+
+        for (int layer = layers - 1; layer >= 0; layer--) {
+            matrixView layerInputs = layer == 0 ? inputs : matrixView(ws.activations[layer - 1]);
+            if (layer > 0 || !ws.sparseGradient) {
+                matrix::matrixMultiply(ws.partialDerivatives[layer], matrix::transposeView(layerInputs), ws.weightGradients[layer]);
+            }
+            matrix::matrixMultiply(ws.partialDerivatives[layer], ones, ws.biasGradients[layer]);
+
+            if (layer > 0) {
+                const matrix& layerActivations = ws.activations[layer - 1];
+                matrix& partialDerivative = ws.partialDerivatives[layer - 1];
+                matrix::matrixMultiply(matrix::transposeView(layerWeights(layer)), ws.partialDerivatives[layer], partialDerivative);
+                partialDerivative = partialDerivative * (layerActivations * (matrix::map(layerActivations, activation::oneMinusFunction())));
+            }
+        }
+    }
+
+    // Adds the gradients of another shard of the same batch.
+    void addGradients(workspace& sum, const workspace& shard) const {
+        for (int layer = 0; layer < layerCount(); layer++) {
+            sum.weightGradients[layer] = sum.weightGradients[layer] + shard.weightGradients[layer];
+            sum.biasGradients[layer] = sum.biasGradients[layer] + shard.biasGradients[layer];
+        }
+        sum.loss += shard.loss;
     }
 
-    // Calculates the average squared error between the given predictions and labels.
-    double cost(matrix predictions, matrix labels) {
-        return matrix::mapSum((predictions - labels), [](double x) {return x * x;}) / predictions.getRows();
+    // Steps every weight and bias against its gradient. The matrices are updated in place, their storage never moves.
+    void applyGradients(const workspace& ws, T rate) {
+        for (int layer = 0; layer < layerCount(); layer++) {
+            if (layer == 0 && ws.sparseGradient) ws.sparseInputs.subtractOuterProducts(inputWeights, ws.partialDerivatives[0], rate);
+            else layerWeights(layer) = layerWeights(layer) - matrix::scalarMultiply(ws.weightGradients[layer], rate);
+            layerBiases(layer) = layerBiases(layer) - matrix::scalarMultiply(ws.biasGradients[layer], rate);
+        }
+    }
+
+    // Returns the given rows of the inputs as columns, and the same rows of the labels.
+    std::tuple<matrixView, matrixView> batch(const matrix& I, const matrix& L, int row, int rows) const {
+        matrixView batchData = matrix::transposeView(matrix::getBlockView(I, row, 0, rows, I.getColumns()));
+        matrixView batchLabels = matrix::getBlockView(L, row, 0, rows, L.getColumns());
+        return std::tuple<matrixView, matrixView>(batchData, batchLabels);
     }
 
 public:
@@ -44,7 +314,7 @@ public:
         std::default_random_engine re(time(0));
         std::uniform_real_distribution<double> unif(lower_bound, upper_bound);
 
-        doubleArray_t inputWeightData, outputBiasData;
+        array_t inputWeightData, outputBiasData;
 
         for (int i = 0; i < hiddenSizes[0]; i++) {
             for (int j = 0; j < inputSize; j++) {
@@ -55,19 +325,19 @@ public:
 
         for (int i = 0; i < hiddenSizes.size() - 1; i++) {
 
-            doubleArray_t hiddenWeightData;
-            doubleArray_t hiddenBiasData;
+            array_t hiddenWeightData;
+            array_t hiddenBiasData;
             for (int j = 0; j < hiddenSizes[i + 1]; j++) {
                 for (int k = 0; k < hiddenSizes[i]; k++) {
                     hiddenWeightData.push_back(unif(re));
                     if (j == 0) hiddenBiasData.push_back(unif(re));
                 }
             }
-            hiddenLayers.push_back(hiddenLayer(matrix(hiddenWeightData, hiddenSizes[i + 1], hiddenSizes[i]), matrix(hiddenBiasData, hiddenSizes[i], 1)));
+            hiddenLayers.push_back(hiddenLayer<T>(matrix(hiddenWeightData, hiddenSizes[i + 1], hiddenSizes[i]), matrix(hiddenBiasData, hiddenSizes[i], 1)));
         }
 
-        doubleArray_t hiddenWeightData;
-        doubleArray_t hiddenBiasData;
+        array_t hiddenWeightData;
+        array_t hiddenBiasData;
         for (int i = 0; i < outputSize; i++) {
             for (int j = 0; j < hiddenSizes.back(); j++) {
                 hiddenWeightData.push_back(unif(re));
@@ -75,7 +345,7 @@ public:
 
             }
         }
-        hiddenLayers.push_back(hiddenLayer(matrix(hiddenWeightData, outputSize, hiddenSizes.back()), matrix(hiddenBiasData, hiddenSizes.back(), 1)));
+        hiddenLayers.push_back(hiddenLayer<T>(matrix(hiddenWeightData, outputSize, hiddenSizes.back()), matrix(hiddenBiasData, hiddenSizes.back(), 1)));
 
 
         for (int i = 0; i < outputSize; i++) {
@@ -84,6 +354,14 @@ public:
         this->outputBiases = matrix(outputBiasData, outputSize, 1);
     }
 
+    // Converts a model with a different element type, e.g. trained double weights into a float model for serving.
+    template <typename U>
+    explicit MLP(const MLP<U>& model) : inputWeights(model.inputWeights), outputBiases(model.outputBiases) {
+        for (int i = 0; i < model.hiddenLayers.size(); i++) {
+            hiddenLayers.push_back(hiddenLayer<T>(matrix(model.hiddenLayers[i].weights), matrix(model.hiddenLayers[i].biases)));
+        }
+    }
+
     // Returns the input weights as a matrix, and hidden weights as a vector of matrices.
     std::tuple<matrix, std::vector<matrix>> getWeights() {
         std::vector<matrix> hiddenWeights;
@@ -104,18 +382,56 @@ public:
         return std::tuple<matrix, std::vector<matrix>>(inputWeights, hiddenBiases);
     }
 
+    // Number of inputs the model takes, one per pixel for the digit model.
+    int getInputSize() const {
+        return inputWeights.getColumns();
+    }
+
+    // Number of outputs the model produces, one per label.
+    int getOutputSize() const {
+        return outputBiases.getRows();
+    }
+
     // Sets the input weights and hidden weights to the given matrix and vector of matrices.
-    void setWeights(matrix inputWeights, std::vector<matrix> hiddenWeights) {
+    void setWeights(const matrix& inputWeights, const std::vector<matrix>& hiddenWeights) {
         if (hiddenWeights.size() != hiddenLayers.size()) throw std::invalid_argument("The number of hidden layers must match the number of hidden weights.");
 
         this->inputWeights = inputWeights;
         for (int i = 0; i < hiddenLayers.size(); i++) {
             hiddenLayers[i].weights = hiddenWeights[i];
         }
+        if (isQuantized()) quantize();
+    }
+
+    // Switches prediction to int8 weights, quantized from the current weights with one scale per row.
+    // Activations are quantized on the fly and products accumulate in int32, see quantizedMatrix.h.
+    // Training always uses the full precision weights and leaves quantized mode.
+    void quantize() {
+        quantizedWeights.clear();
+        quantizedWeights.push_back(quantizedMatrix(inputWeights));
+        for (int i = 0; i < hiddenLayers.size(); i++) {
+            quantizedWeights.push_back(quantizedMatrix(hiddenLayers[i].weights));
+        }
+    }
+
+    // Switches prediction back to the full precision weights.
+    void dequantize() {
+        quantizedWeights.clear();
+    }
+
+    bool isQuantized() const {
+        return !quantizedWeights.empty();
+    }
+
+    // Folds a normalization of the inputs, inputs * scale, into the input weights, since W * (inputs * scale) = (W * scale) * inputs.
+    // Afterwards the model takes the inputs before normalization, e.g. raw pixels with a scale of 1 / 255, at no extra cost.
+    void foldInputScale(double scale) {
+        inputWeights = matrix::scalarMultiply(inputWeights, scale);
+        if (isQuantized()) quantize();
     }
 
     // Sets the output biases and hidden biases to the given matrix and vector of matrices.
-    void setBiases(matrix outputBiases, std::vector<matrix> hiddenBiases) {
+    void setBiases(const matrix& outputBiases, const std::vector<matrix>& hiddenBiases) {
         if (hiddenBiases.size() != hiddenLayers.size()) throw std::invalid_argument("The number of hidden layers must match the number of hidden biases.");
 
         this->outputBiases = outputBiases;
@@ -125,95 +441,269 @@ public:
     }
 
     // Returns a tuple containing a vector of activation matrices, and a single matrix containing the output values.
-    // Takes in a m x n matrix of training inputs where m is the amount of training examples, and n is the amount of features/inputs per example.
-    std::tuple<std::vector<matrix>, matrix> prediction(matrix I) {
+    // Takes in a n x 1 column of inputs, usually a view into a row of a larger matrix of examples, or a n x B
+    // matrix with a batch of inputs as its columns, in which case every activation has a column per input.
+    std::tuple<std::vector<matrix>, matrix> prediction(const matrixView& I) const {
         std::vector<matrix> hiddenActivations;
 
-        matrix firstWS = summation(inputWeights, I, hiddenLayers[0].biases);
-        matrix firstActivation = sigmoid(firstWS);
-        hiddenActivations.push_back(firstActivation);
+        hiddenActivations.push_back(layerActivation(0, I));
 
         for (int i = 0; i < hiddenLayers.size() - 1; i++) {
-            matrix hiddenWS = summation(hiddenLayers[i].weights, hiddenActivations[i], hiddenLayers[i + 1].biases);
-            matrix hiddenActivation = sigmoid(hiddenWS);
-            hiddenActivations.push_back(hiddenActivation);
+            hiddenActivations.push_back(layerActivation(i + 1, hiddenActivations[i]));
         }
 
-        matrix lastWs = summation(hiddenLayers.back().weights, hiddenActivations.back(), outputBiases);
-        matrix lastActivation = sigmoid(lastWs);
+        matrix lastActivation = layerActivation(hiddenLayers.size(), hiddenActivations.back());
 
         return std::tuple<std::vector<matrix>, matrix>(hiddenActivations, lastActivation);
     }
 
-    // Takes in a m x n matrix of training inputs where m is the amount of training examples, and n is the amount of features per example. Takes in matrix of training labels with m rows.
-    // This function 'trains' the model by making predictions via forward propagation, and then backpropagating the error and adjusting the weights and biases to minimize the error between its prediction and the real value.
-    // Returns the updated weights and biases, and an array of error values corresponding to each epoch.
-    std::tuple<matrix, matrix, std::vector<hiddenLayer>, doubleArray_t> train(matrix I, matrix L, double learningRate = 0.01, double maxEpochs = 100, double errorCutoff = 1e-3) {
-        int epoch = 0;
-        doubleArray_t errors;
-        double error = 1000.0;
+    // Returns a workspace for back propagating batches of up to batchSize examples, with every matrix allocated at its full size.
+    workspace createWorkspace(int batchSize) const {
+        if (batchSize < 1) throw std::invalid_argument("The batch size must be at least 1.");
+
+        workspace ws;
+        for (int layer = 0; layer < layerCount(); layer++) {
+            const matrix& weights = layerWeights(layer);
+            ws.activations.push_back(matrix(array_t(weights.getRows() * batchSize), weights.getRows(), batchSize));
+            ws.partialDerivatives.push_back(matrix(array_t(weights.getRows() * batchSize), weights.getRows(), batchSize));
+            ws.weightGradients.push_back(matrix(array_t(weights.getRows() * weights.getColumns()), weights.getRows(), weights.getColumns()));
+            ws.biasGradients.push_back(matrix(array_t(weights.getRows()), weights.getRows(), 1));
+        }
+        ws.labels = matrix(array_t(ws.activations.back().getRows() * batchSize), ws.activations.back().getRows(), batchSize);
+        ws.ones = matrix(array_t(batchSize, 1), batchSize, 1);
+        ws.loss = 0.0;
+        return ws;
+    }
 
-        // Define threshold to stop the training process
-        while (epoch <= maxEpochs && error > errorCutoff) {
-            double loss = 0.0;
+    // Trains on a single batch, the given rows of the inputs and labels, and returns its summed cost. The batch must not be larger
+    // than the workspace, in which case nothing is allocated.
+    double trainBatch(const matrix& I, const matrix& L, int row, int rows, workspace& ws, double learningRate) {
+        if (rows > ws.ones.getRows()) throw std::invalid_argument("The batch is larger than the workspace.");
 
-            for (int i = 0; i < I.getRows(); i++) {
-                matrix testData = matrix::transpose(matrix::getRow(I, i));
-                matrix testLabel = matrix::transpose(matrix::getRow(L, i));
+        auto [batchData, batchLabels] = batch(I, L, row, rows);
+        backpropagate(batchData, batchLabels, ws, true);
 
-                // ---------- Forward propagation ----------
-                auto [hiddenAs, lastA] = prediction(testData);
+        // The gradients are summed over the batch, so the rate is divided by its size to average them.
+        applyGradients(ws, learningRate / rows);
+        return ws.loss;
+    }
 
-                // ---------- Calculate error/loss ----------
-                loss += cost(lastA, testLabel);
+    // Returns buffers for inference on up to batchSize inputs at a time without allocating.
+    inferenceBuffers createInferenceBuffers(int batchSize = 1) const {
+        if (batchSize < 1) throw std::invalid_argument("The batch size must be at least 1.");
 
+        int widest = 0;
+        for (int layer = 0; layer < layerCount(); layer++) {
+            widest = std::max(widest, (int)layerWeights(layer).getRows());
+        }
 
-                // ---------- Back propagation to update weights and biases ----------
+        inferenceBuffers buffers;
+        buffers.front = matrix(array_t(widest * batchSize), widest, batchSize);
+        buffers.back = matrix(array_t(widest * batchSize), widest, batchSize);
+        return buffers;
+    }
 
-                matrix lastPartialDerivative = matrix::scalarMultiply(lastA - testLabel, 2.0) * (lastA * (matrix::map(lastA, [](double x) { return 1.0 - x; })));
+    // Returns the outputs for a column of inputs, or a batch of inputs as columns, like prediction but without keeping the hidden
+    // activations. The result lives in one of the buffers and is overwritten by the next call that uses them. Batches larger than
+    // the buffers were created for grow them.
+    const matrix& infer(const matrixView& I, inferenceBuffers& buffers) const {
+        return forward(0, I, buffers);
+    }
 
-                matrix lastWeightGradient = matrix::matrixMultiply(lastPartialDerivative, matrix::transpose(hiddenAs.back()));
+    // Infers a single column of inputs and returns the label with the largest output, and that output as its confidence.
+    classification classify(const matrixView& I, inferenceBuffers& buffers) const {
+        if (I.getColumns() != 1) throw std::invalid_argument("Only a single column of inputs can be classified.");
 
-                std::vector<matrix> hiddenPartialDerivatives;
-                std::vector<matrix> hiddenWeightGradients;
-                hiddenPartialDerivatives.push_back(lastPartialDerivative);
-                hiddenWeightGradients.push_back(lastWeightGradient);
+        const matrix& outputs = infer(I, buffers);
+        const T* data = outputs.getData().data();
 
-                for (int i = hiddenAs.size() - 1; i > 0; i--) {
-                    matrix hiddenPartialDerivative = matrix::matrixMultiply(matrix::transpose(hiddenLayers[i].weights), hiddenPartialDerivatives[hiddenAs.size() - 1 - i]) * (hiddenAs[i] * (matrix::map(hiddenAs[i], [](double x) { return 1.0 - x; })));
-                    matrix hiddenWeightGradient = matrix::matrixMultiply(hiddenPartialDerivative, matrix::transpose(hiddenAs[i - 1]));
+        classification result = { 0, data[0] };
+        for (int i = 1; i < outputs.getRows(); i++) {
+            if (data[i] > result.confidence) result = { i, data[i] };
+        }
+        return result;
+    }
+
+    // Starts an incremental inference session on a single column of inputs, see updateSession. The first layer of a session always
+    // uses the full precision weights, in quantized mode too.
+    inferenceSession createSession(const matrixView& I) const {
+        if (I.getRows() != inputWeights.getColumns() || I.getColumns() != 1) throw std::invalid_argument("A session starts from a single column of inputs.");
 
-                    hiddenPartialDerivatives.push_back(hiddenPartialDerivative);
-                    hiddenWeightGradients.push_back(hiddenWeightGradient);
+        inferenceSession session;
+        session.inputs = array_t(I.getRows());
+        for (int j = 0; j < I.getRows(); j++) {
+            session.inputs[j] = I(j, 0);
+        }
+        session.preActivations = array_t(inputWeights.getRows());
+        session.activations = array_t(inputWeights.getRows());
+        session.buffers = createInferenceBuffers();
+        session.deltas.reserve(I.getRows());
+        recomputeSession(session);
+        return session;
+    }
+
+    // Sets the given inputs of the session to their new values and returns the outputs for the updated inputs, like infer. Only the
+    // columns of the first layer's weights that belong to changed inputs are read, a product of O(rows * changes) instead of
+    // O(rows * inputs), then the remaining layers run as usual. Many changes at once, see incrementalDensity, or many updates since
+    // the last full product, recompute the first layer in full instead. The result lives in the buffers of the session until the next update.
+    const matrix& updateSession(inferenceSession& session, const std::vector<inputChange>& changes) const {
+        int inputs = session.inputs.size();
+
+        session.deltas.clear();
+        for (const inputChange& change : changes) {
+            if (change.index < 0 || change.index >= inputs) throw std::invalid_argument("The index of a changed input is out of range.");
+
+            T delta = change.value - session.inputs[change.index];
+            if (delta != 0) session.deltas.push_back({ change.index, delta });
+            session.inputs[change.index] = change.value;
+        }
+
+        if ((long)session.deltas.size() > incrementalDensity * inputs || ++session.updates > 256) {
+            recomputeSession(session);
+        }
+        else if (!session.deltas.empty()) {
+            // Four rows at a time, so the weights are read in memory order and the sums of the rows add up independently of each
+            // other. The changes of a stroke are mostly close together, within a few cache lines of every row.
+            const T* weights = inputWeights.getData().data();
+            T* preActivations = session.preActivations.data();
+            int rows = inputWeights.getRows();
+            int i = 0;
+            for (; i + 4 <= rows; i += 4) {
+                const T* row = weights + (long)inputs * i;
+                T sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+                for (const auto& [index, delta] : session.deltas) {
+                    sum0 += row[index] * delta;
+                    sum1 += row[inputs + index] * delta;
+                    sum2 += row[2L * inputs + index] * delta;
+                    sum3 += row[3L * inputs + index] * delta;
                 }
+                preActivations[i] += sum0;
+                preActivations[i + 1] += sum1;
+                preActivations[i + 2] += sum2;
+                preActivations[i + 3] += sum3;
+            }
+            for (; i < rows; i++) {
+                const T* row = weights + (long)inputs * i;
+                T sum = 0;
+                for (const auto& [index, delta] : session.deltas) {
+                    sum += row[index] * delta;
+                }
+                preActivations[i] += sum;
+            }
+            activation::sigmoid(session.preActivations.data(), session.activations.data(), session.activations.size());
+        }
 
-                matrix firstPartialDerivative = matrix::matrixMultiply(matrix::transpose(hiddenLayers[0].weights), hiddenPartialDerivatives.back()) * (hiddenAs[0] * (matrix::map(hiddenAs[0], [](double x) { return 1.0 - x; })));
-                hiddenPartialDerivatives.push_back(firstPartialDerivative);
-                matrix firstWeightGradient = matrix::matrixMultiply(firstPartialDerivative, matrix::transpose(testData));
+        matrixView activations = matrixView(session.activations.data(), session.activations.size(), 1, 1, 1);
+        return forward(1, activations, session.buffers);
+    }
 
-                outputBiases = outputBiases - matrix::scalarMultiply(lastPartialDerivative, learningRate);
-                for (int i = hiddenLayers.size() - 1; i >= 0; i--) {
-                    hiddenLayers[i].weights = hiddenLayers[i].weights - matrix::scalarMultiply(hiddenWeightGradients[hiddenLayers.size() - 1 - i], learningRate);
-                    hiddenLayers[i].biases = hiddenLayers[i].biases - matrix::scalarMultiply(hiddenPartialDerivatives[hiddenLayers.size() - i], learningRate);
+    // Takes in a m x n matrix of training inputs where m is the amount of training examples, and n is the amount of features per example. Takes in matrix of training labels with m rows.
+    // This function 'trains' the model by making predictions via forward propagation, and then backpropagating the error and adjusting the weights and biases to minimize the error between its prediction and the real value.
+    // Examples are processed batchSize at a time, each batch is forward and back propagated as one matrix with an example per column, so the
+    // products are matrix-matrix products, and the weights are updated once per batch with the gradient averaged over the batch.
+    // A batchSize of 1 is plain per-example stochastic gradient descent.
+    //
+    // With more than one worker the training is data parallel on the matrix thread pool. By default every batch is split into one shard
+    // per worker, each worker back propagates its shard into its own activations and gradients, and the shard gradients are summed in a
+    // tree before the single update, so the result matches a single worker up to rounding. With hogwild set, every worker instead trains
+    // on its own share of the batches and updates the shared weights without any locking, Hogwild style. The updates race with the
+    // other workers' reads and writes, which Hogwild accepts in exchange for never waiting on a reduction.
+    // Returns the updated weights and biases, and an array of error values corresponding to each epoch.
+    std::tuple<matrix, matrix, std::vector<hiddenLayer<T>>, doubleArray_t> train(const matrix& I, const matrix& L, double learningRate = 0.01, double maxEpochs = 100, double errorCutoff = 1e-3, int batchSize = 1, int workers = 1, bool hogwild = false) {
+        if (batchSize < 1) throw std::invalid_argument("The batch size must be at least 1.");
+        if (workers < 1) throw std::invalid_argument("There must be at least one worker.");
+
+        dequantize();
+
+        threadPool& pool = threadPool::getInstance();
+        int examples = I.getRows();
+        int batches = (examples + batchSize - 1) / batchSize;
+
+        // Every buffer is allocated before the first epoch, one workspace per worker in Hogwild mode, and one per shard of a batch
+        // otherwise, so the epochs themselves do not allocate.
+        int shardSize = hogwild ? batchSize : (batchSize + workers - 1) / workers;
+        int workspaceCount = hogwild ? workers : std::min(workers, batchSize);
+        std::vector<workspace> workspaces;
+        for (int w = 0; w < workspaceCount; w++) {
+            workspaces.push_back(createWorkspace(shardSize));
+        }
+        doubleArray_t workerLoss(workers);
+
+        int epoch = 0;
+        doubleArray_t errors;
+        double error = 1000.0;
+
+        // Define threshold to stop the training process
+        while (epoch <= maxEpochs && error > errorCutoff) {
+            auto epochStart = std::chrono::steady_clock::now();
+            double loss = 0.0;
+
+            if (hogwild && workers > 1) {
+                std::fill(workerLoss.begin(), workerLoss.end(), 0.0);
+                pool.parallelFor(0, workers, 1, [&](int firstWorker, int lastWorker) {
+                    for (int w = firstWorker; w < lastWorker; w++) {
+                        for (int b = (long)batches * w / workers; b < (long)batches * (w + 1) / workers; b++) {
+                            int size = std::min(batchSize, examples - b * batchSize);
+                            workerLoss[w] += trainBatch(I, L, b * batchSize, size, workspaces[w], learningRate);
+                        }
+                    }
+                });
+
+                for (int w = 0; w < workers; w++) {
+                    loss += workerLoss[w];
+                }
+            }
+            else {
+                for (int i = 0; i < examples; i += batchSize) {
+                    int size = std::min(batchSize, examples - i);
+                    int shards = std::min(workers, size);
+
+                    if (shards == 1) {
+                        loss += trainBatch(I, L, i, size, workspaces[0], learningRate);
+                        continue;
+                    }
+
+                    pool.parallelFor(0, shards, 1, [&](int firstShard, int lastShard) {
+                        for (int s = firstShard; s < lastShard; s++) {
+                            int first = i + size * s / shards;
+                            int last = i + size * (s + 1) / shards;
+                            auto [shardData, shardLabels] = batch(I, L, first, last - first);
+                            backpropagate(shardData, shardLabels, workspaces[s]);
+                        }
+                    });
+
+                    // Pairwise tree reduction, each level halves the shards left and sums its pairs in parallel.
+                    for (int stride = 1; stride < shards; stride *= 2) {
+                        pool.parallelFor(0, (shards + 2 * stride - 1) / (2 * stride), 1, [&](int firstPair, int lastPair) {
+                            for (int p = firstPair; p < lastPair; p++) {
+                                int s = 2 * stride * p;
+                                if (s + stride < shards) addGradients(workspaces[s], workspaces[s + stride]);
+                            }
+                        });
+                    }
+
+                    // The gradients are summed over the batch, so the rate is divided by its size to average them.
+                    applyGradients(workspaces[0], learningRate / size);
+                    loss += workspaces[0].loss;
                 }
-                inputWeights = inputWeights - matrix::scalarMultiply(firstWeightGradient, learningRate);
             }
 
+            std::chrono::duration<double> epochTime = std::chrono::steady_clock::now() - epochStart;
             error = loss / I.getRows();
             errors.push_back(error);
-            std::cout << "Epoch: " << epoch << ". Loss: " << error << "." << std::endl;
+            std::cout << "Epoch: " << epoch << ". Loss: " << error << ". Time: " << epochTime.count() << "s." << std::endl;
             epoch++;
         }
 
-        return std::tuple<matrix, matrix, std::vector<hiddenLayer>, doubleArray_t>(inputWeights, outputBiases, hiddenLayers, errors);
+        return std::tuple<matrix, matrix, std::vector<hiddenLayer<T>>, doubleArray_t>(inputWeights, outputBiases, hiddenLayers, errors);
     }
 
     // Tests the trained model against the provided test data and labels, and prints out the accuracy.
-    void test(matrix I, matrix L) {
+    void test(const matrix& I, const matrix& L) {
         int correct = 0;
         for (int i = 0; i < I.getRows(); i++) {
-            matrix testData = matrix::transpose(matrix::getRow(I, i));
-            matrix testLabel = matrix::transpose(matrix::getRow(L, i));
+            matrixView testData = matrix::transposeView(matrix::getRowView(I, i));
+            matrixView testLabel = matrix::transposeView(matrix::getRowView(L, i));
 
             auto [hiddenAs, lastA] = prediction(testData);
 
@@ -236,4 +726,6 @@ public:
         std::cout << "Accuracy: " << (double)correct / I.getRows() * 100 << "%" << std::endl;
     }
 
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include <matrix.h>
+#include <activation.h>
+#include <avx2Vector.h>
+#include <threadPool.h>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+// An inference only MLP whose topology is fixed at compile time, e.g. floatStaticMLP<784, 392, 196, 98, 49, 25, 10> for
+// the served network. Sizes lists the input layer, every hidden layer, and the output layer.
+//
+// Every layer is its own type with constexpr dimensions, so its weights live in one aligned block of fixed size and
+// its kernel is instantiated for exactly that shape. Rows of weights are zero padded to a whole number of AVX2
+// iterations, so the kernels have no tail loops and the compiler can unroll the inner loop of the small layers
+// completely. The activations alternate between two fixed size buffers on the stack. The runtime MLP stays the
+// model for training and for experimenting with other topologies, this class is only built from its weights.
+//
+// Only the float version is faster than the runtime MLP. With double weights the layers are bound by reading the weights
+// rather than by the loop overhead this class removes, and benchmark/staticLatency.cpp measures StaticMLP at or slightly
+// below the speed of MLP<double>, so it gives no latency gain and is kept for comparing outputs.
+template <typename T, int... Sizes>
+class basicStaticMLP {
+    static_assert(sizeof...(Sizes) >= 3, "There must be one input layer, one output layer, and at least one hidden layer.");
+
+public:
+    static constexpr int dims[] = { Sizes... };
+
+    static constexpr int layerCount = sizeof...(Sizes) - 1;
+
+    static constexpr int inputSize = dims[0];
+
+    static constexpr int outputSize = dims[layerCount];
+
+    // The label with the largest output, and that output as its confidence.
+    struct classification {
+        int label;
+        T confidence;
+    };
+
+private:
+    // Elements per AVX2 iteration of the kernels, two vectors.
+    static constexpr int step = 2 * avx2Vector<T>::width;
+
+    static constexpr int padded(int size) {
+        return (size + step - 1) / step * step;
+    }
+
+    // The activation buffers hold the widest layer, padded like a row of weights.
+    static constexpr int bufferSize() {
+        int widest = 0;
+        for (int size : dims) widest = std::max(widest, padded(size));
+        return widest;
+    }
+
+    // Layers with at least this many multiply-adds split their rows across the thread pool.
+    static constexpr long parallelThreshold = 1 << 16;
+
+    // Weights of a layer with the given number of outputs (Rows) and inputs (Columns). Row i starts at
+    // weights[i * stride], the padding at the end of every row is zero.
+    template <int Rows, int Columns>
+    struct staticLayer {
+        static constexpr int rows = Rows;
+        static constexpr int columns = Columns;
+        static constexpr int stride = padded(Columns);
+
+        alignas(64) T weights[Rows * stride] = {};
+        alignas(64) T biases[Rows] = {};
+    };
+
+    template <size_t... I>
+    static std::tuple<staticLayer<dims[I + 1], dims[I]>...> layerTypes(std::index_sequence<I...>);
+
+    typedef decltype(layerTypes(std::make_index_sequence<layerCount>())) layers_t;
+
+    // Several megabytes for the served network, so the layers live on the heap.
+    std::unique_ptr<layers_t> layers;
+
+    // Dot products of the rows [firstRow, lastRow) with the padded inputs, plus the biases, for CPUs without AVX2.
+    template <typename L>
+    static void scalarRows(const L& layer, const T* in, T* out, int firstRow, int lastRow) {
+        for (int i = firstRow; i < lastRow; i++) {
+            const T* row = layer.weights + (long)L::stride * i;
+            T dot = 0;
+            for (int j = 0; j < L::columns; j++) {
+                dot += row[j] * in[j];
+            }
+            out[i] = dot + layer.biases[i];
+        }
+    }
+
+    // Same as scalarRows with AVX2. Four rows at a time share every load of the inputs, and firstRow is always a multiple of four.
+    template <typename L>
+    __attribute__((target("avx2,fma")))
+    static void avx2Rows(const L& layer, const T* in, T* out, int firstRow, int lastRow) {
+        typedef avx2Vector<T> V;
+        const int W = V::width;
+
+        int i = firstRow;
+        for (; i + 4 <= lastRow; i += 4) {
+            const T* row = layer.weights + (long)L::stride * i;
+            typename V::type first[4] = { V::zero(), V::zero(), V::zero(), V::zero() };
+            typename V::type second[4] = { V::zero(), V::zero(), V::zero(), V::zero() };
+
+#pragma GCC unroll 8
+            for (int j = 0; j < L::stride; j += step) {
+                typename V::type x0 = V::load(in + j);
+                typename V::type x1 = V::load(in + j + W);
+#pragma GCC unroll 4
+                for (int r = 0; r < 4; r++) {
+                    first[r] = V::fmadd(V::load(row + L::stride * r + j), x0, first[r]);
+                    second[r] = V::fmadd(V::load(row + L::stride * r + j + W), x1, second[r]);
+                }
+            }
+
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                out[i + r] = V::sum(V::add(first[r], second[r])) + layer.biases[i + r];
+            }
+        }
+
+        if constexpr (L::rows % 4 != 0) {
+            for (; i < lastRow; i++) {
+                const T* row = layer.weights + (long)L::stride * i;
+                typename V::type first = V::zero(), second = V::zero();
+#pragma GCC unroll 8
+                for (int j = 0; j < L::stride; j += step) {
+                    first = V::fmadd(V::load(row + j), V::load(in + j), first);
+                    second = V::fmadd(V::load(row + j + W), V::load(in + j + W), second);
+                }
+                out[i] = V::sum(V::add(first, second)) + layer.biases[i];
+            }
+        }
+    }
+
+    // out = sigmoid(W * in + b) for one layer. in holds L::stride values, out receives L::rows values.
+    template <typename L>
+    static void forward(const L& layer, const T* in, T* out) {
+        auto rowLoop = [&](int firstRow, int lastRow) {
+            if (activation::avx2Supported()) avx2Rows(layer, in, out, firstRow, lastRow);
+            else scalarRows(layer, in, out, firstRow, lastRow);
+        };
+
+        if constexpr ((long)L::rows * L::columns >= parallelThreshold) {
+            threadPool& pool = threadPool::getInstance();
+            int chunkSize = std::max(32, (L::rows / (int)(2 * pool.getConcurrency()) + 31) / 32 * 32);
+            pool.parallelFor(0, L::rows, chunkSize, rowLoop);
+        }
+        else {
+            rowLoop(0, L::rows);
+        }
+
+        activation::sigmoid(out, out, L::rows);
+    }
+
+    // Copies the weights and biases of one layer out of the runtime representation.
+    template <typename L>
+    static void load(L& layer, const matrix& weights, const matrix& biases) {
+        if (weights.getRows() != L::rows || weights.getColumns() != L::columns) {
+            throw std::invalid_argument("The weights do not match the dimensions of the layer.");
+        }
+        if (biases.getRows() != L::rows || biases.getColumns() != 1) {
+            throw std::invalid_argument("The biases do not match the dimensions of the layer.");
+        }
+
+        for (int i = 0; i < L::rows; i++) {
+            for (int j = 0; j < L::columns; j++) {
+                layer.weights[(long)L::stride * i + j] = (T)weights(i, j);
+            }
+            layer.biases[i] = (T)biases(i, 0);
+        }
+    }
+
+    template <size_t... I>
+    void loadAll(const matrix& inputWeights, const matrix& outputBiases, const std::vector<matrix>& hiddenWeights,
+        const std::vector<matrix>& hiddenBiases, std::index_sequence<I...>) {
+        (load(std::get<I>(*layers), I == 0 ? inputWeights : hiddenWeights[I - 1], I == layerCount - 1 ? outputBiases : hiddenBiases[I]), ...);
+    }
+
+    // Runs every layer, alternating between the two buffers. Returns the buffer holding the outputs.
+    template <size_t... I>
+    const T* forwardAll(T* front, T* back, std::index_sequence<I...>) const {
+        ((forward(std::get<I>(*layers), I % 2 == 0 ? front : back, I % 2 == 0 ? back : front)), ...);
+        return layerCount % 2 == 0 ? front : back;
+    }
+
+public:
+    // Takes the weights and biases in the layout of the runtime MLP and of readFromFile: the input weights, the output biases,
+    // then the weights of every later layer and the biases of every layer but the last.
+    basicStaticMLP(const matrix& inputWeights, const matrix& outputBiases, const std::vector<matrix>& hiddenWeights, const std::vector<matrix>& hiddenBiases)
+        : layers(new layers_t()) {
+        if (hiddenWeights.size() != layerCount - 1 || hiddenBiases.size() != layerCount - 1) {
+            throw std::invalid_argument("The number of hidden layers must match the topology of the model.");
+        }
+
+        loadAll(inputWeights, outputBiases, hiddenWeights, hiddenBiases, std::make_index_sequence<layerCount>());
+    }
+
+    // Returns the outputs for a column of inputSize inputs.
+    std::array<T, outputSize> infer(const basicMatrixView<T>& I) const {
+        if (I.getRows() != inputSize || I.getColumns() != 1) throw std::invalid_argument("The inputs must be a single column with one row per input.");
+
+        // The padding of the buffers meets zero weights, it only has to hold finite values.
+        alignas(64) T front[bufferSize()] = {};
+        alignas(64) T back[bufferSize()] = {};
+
+        const T* input = I.getPointer();
+        for (int j = 0; j < inputSize; j++) {
+            front[j] = input[I.getRowStride() * j];
+        }
+
+        const T* output = forwardAll(front, back, std::make_index_sequence<layerCount>());
+
+        std::array<T, outputSize> outputs;
+        std::copy(output, output + outputSize, outputs.begin());
+        return outputs;
+    }
+
+    // Infers a column of inputs and returns the label with the largest output, and that output as its confidence.
+    classification classify(const basicMatrixView<T>& I) const {
+        std::array<T, outputSize> outputs = infer(I);
+
+        classification result = { 0, outputs[0] };
+        for (int i = 1; i < outputSize; i++) {
+            if (outputs[i] > result.confidence) result = { i, outputs[i] };
+        }
+        return result;
+    }
+};
+
+// Most code uses these rather than basicStaticMLP, like matrix and floatMatrix.
+template <int... Sizes>
+using StaticMLP = basicStaticMLP<double, Sizes...>;
+
+template <int... Sizes>
+using floatStaticMLP = basicStaticMLP<float, Sizes...>;
@@ -0,0 +1,337 @@
+#ifndef BATCHSCHEDULER_CPP
+#define BATCHSCHEDULER_CPP
+
+#include <multilayerPerceptron.cpp>
+#include <metrics.cpp>
+#include <App.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Collects prediction requests that arrive close together into one batch, so the model runs a single matrix-matrix forward pass
+// instead of one matrix-vector pass per request. A batch is run as soon as it holds maxBatchSize requests, or once its oldest
+// request has waited maxWaitMicroseconds, whichever comes first. A maxBatchSize of 1 runs every request on its own.
+//
+// Batches run on a pool of worker threads owned by the scheduler, so the event loops only accept and parse requests and stay
+// responsive while inference is saturated. Each worker forms its own batches from the shared queue, with its own inference buffers.
+// The result of each request is handed back to the event loop it was submitted from through uWS::Loop::defer, so the completion
+// callback runs on that loop's thread and may use its HttpResponse. Requests whose client is gone by the time a worker picks them
+// up are dropped without running, see submit.
+//
+// The model can be replaced while the server runs, see setModel. Every batch runs on the model that was current when it started.
+template <typename T>
+class batchScheduler {
+
+public:
+    typedef typename MLP<T>::classification classification;
+
+    // Called with the predicted label and its confidence, or a label of -1 when the prediction failed.
+    typedef std::function<void(classification result)> callback_t;
+
+    // Called with the label and confidence of every image of a batch request in order, or with none when the prediction failed.
+    typedef std::function<void(std::vector<classification> results)> batchCallback_t;
+
+    // Number of buckets of the wait time histogram, bucket b counts waits below 2^b microseconds.
+    static const int waitBuckets = 24;
+
+private:
+    struct request {
+        std::vector<T> input;
+        uWS::Loop* loop;
+        callback_t done;
+        batchCallback_t doneBatch;
+        std::shared_ptr<const std::atomic<bool>> cancelled;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    // Only ever accessed through std::atomic_load and std::atomic_store.
+    std::shared_ptr<const MLP<T>> model;
+
+    // Every model the scheduler runs takes inputSize inputs and has outputSize outputs.
+    int inputSize;
+
+    int outputSize;
+
+    int maxBatchSize;
+
+    long maxWaitMicroseconds;
+
+    // Requests beyond this many queued ones are turned away rather than queued behind a growing backlog.
+    int queueLimit;
+
+    std::mutex lock;
+    std::condition_variable signal;
+    std::deque<request> queue;
+    bool stopping = false;
+
+    // batchSizes[n] counts the batches of n requests.
+    std::vector<std::atomic<long>> batchSizes;
+
+    // Time from submit until the batch of a request starts running.
+    std::atomic<long> waitTimes[waitBuckets] = {};
+
+    std::atomic<long> rejected{ 0 };
+
+    std::atomic<long> cancelledRequests{ 0 };
+
+    std::atomic<long> batchRequests{ 0 };
+
+    std::atomic<long> batchRequestImages{ 0 };
+
+    std::vector<std::thread> workers;
+
+    static int waitBucket(long microseconds) {
+        int bucket = 0;
+        while (bucket < waitBuckets - 1 && microseconds >= (1L << bucket)) bucket++;
+        return bucket;
+    }
+
+    // Runs the model on inputs, one example per row, and returns the label and confidence of every example, or nothing when
+    // the model failed.
+    static std::vector<classification> classify(const MLP<T>& model, basicMatrix<T> inputs, typename MLP<T>::inferenceBuffers& buffers) {
+        int size = inputs.getRows();
+        std::vector<classification> results;
+        try {
+            // The transposed view hands the model one example per column.
+            const basicMatrix<T>& outputs = model.infer(basicMatrix<T>::transposeView(inputs), buffers);
+            const T* data = outputs.getData().data();
+            results.reserve(size);
+            for (int c = 0; c < size; c++) {
+                classification result = { 0, data[c] };
+                for (int i = 1; i < outputs.getRows(); i++) {
+                    if (data[size * i + c] > result.confidence) result = { i, data[size * i + c] };
+                }
+                results.push_back(result);
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Batch of " << size << " failed: " << e.what() << std::endl;
+            results.clear();
+        }
+        return results;
+    }
+
+    // Waits for a batch, runs it, and posts the results, until the scheduler is destroyed. A batch request, see submitBatch,
+    // is run on its own, the single requests around it are left for the next batch.
+    void run() {
+        std::vector<request> batch;
+        batch.reserve(maxBatchSize);
+        std::shared_ptr<const MLP<T>> current;
+        typename MLP<T>::inferenceBuffers buffers;
+
+        while (true) {
+            bool more;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                signal.wait(guard, [&]() { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+
+                // The batch fills up to the deadline of its oldest request, a stopping scheduler drains what it has. A batch
+                // request is already full.
+                if (queue.front().doneBatch == nullptr) {
+                    auto deadline = queue.front().arrival + std::chrono::microseconds(maxWaitMicroseconds);
+                    signal.wait_until(guard, deadline, [&]() { return stopping || (int)queue.size() >= maxBatchSize; });
+                }
+
+                while (!queue.empty() && (int)batch.size() < maxBatchSize) {
+                    request& next = queue.front();
+                    if (next.cancelled != nullptr && *next.cancelled) cancelledRequests++;
+                    else if (next.doneBatch != nullptr && !batch.empty()) break;
+                    else batch.push_back(std::move(next));
+                    queue.pop_front();
+                    if (batch.size() == 1 && batch[0].doneBatch != nullptr) break;
+                }
+                more = !queue.empty();
+            }
+            // Another worker may start on what is left while this one runs its batch.
+            if (more) signal.notify_one();
+            if (batch.empty()) continue;
+
+            // The buffers follow the model, whose hidden layers may differ from those of the one before.
+            std::shared_ptr<const MLP<T>> latest = std::atomic_load(&model);
+            if (latest != current) {
+                current = std::move(latest);
+                buffers = current->createInferenceBuffers(maxBatchSize);
+                buffers.timeLayers = true;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (request& r : batch) {
+                long waited = std::chrono::duration_cast<std::chrono::microseconds>(start - r.arrival).count();
+                waitTimes[waitBucket(waited)]++;
+                metrics::getInstance().record(metrics::queue, start - r.arrival);
+            }
+
+            if (batch[0].doneBatch != nullptr) {
+                request& r = batch[0];
+                int size = r.input.size() / inputSize;
+                batchRequests++;
+                batchRequestImages += size;
+
+                // The inputs of a batch request already are one example per row.
+                std::vector<classification> results = classify(*current, basicMatrix<T>(std::move(r.input), size, inputSize), buffers);
+                metrics::getInstance().recordLayers(buffers.layerNanoseconds);
+                r.loop->defer([done = std::move(r.doneBatch), results = std::move(results)]() mutable { done(std::move(results)); });
+                batch.clear();
+                continue;
+            }
+
+            int size = batch.size();
+            std::vector<T> inputData;
+            inputData.reserve((size_t)size * inputSize);
+            for (request& r : batch) {
+                inputData.insert(inputData.end(), r.input.begin(), r.input.end());
+            }
+            batchSizes[size]++;
+
+            std::vector<classification> results = classify(*current, basicMatrix<T>(std::move(inputData), size, inputSize), buffers);
+            metrics::getInstance().recordLayers(buffers.layerNanoseconds);
+            for (int c = 0; c < size; c++) {
+                classification result = results.empty() ? classification{ -1, 0 } : results[c];
+                batch[c].loop->defer([done = std::move(batch[c].done), result]() { done(result); });
+            }
+            batch.clear();
+        }
+    }
+
+public:
+    batchScheduler(std::shared_ptr<const MLP<T>> model, int maxBatchSize, long maxWaitMicroseconds, int workerCount = 1, int queueLimit = 1024)
+        : model(model), inputSize(model->getInputSize()), outputSize(model->getOutputSize()), maxBatchSize(maxBatchSize), maxWaitMicroseconds(maxWaitMicroseconds), queueLimit(queueLimit), batchSizes(maxBatchSize + 1) {
+        if (maxBatchSize < 1) throw std::invalid_argument("The batch size must be at least 1.");
+        if (maxWaitMicroseconds < 0) throw std::invalid_argument("The wait time can not be negative.");
+        if (workerCount < 1) throw std::invalid_argument("There must be at least one worker.");
+        if (queueLimit < 1) throw std::invalid_argument("The queue limit must be at least 1.");
+
+        for (int w = 0; w < workerCount; w++) {
+            workers.push_back(std::thread([this]() { run(); }));
+        }
+    }
+
+    // Runs the requests still queued, then stops the workers. Their callbacks are still deferred to their loops.
+    ~batchScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        signal.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    batchScheduler(const batchScheduler&) = delete;
+
+    batchScheduler& operator=(const batchScheduler&) = delete;
+
+    // Queues a single input and calls done with its result on the event loop of the calling thread. Once cancelled is set, typically
+    // by the onAborted handler of the response, the request is dropped if it has not started running, and done is never called.
+    // done must still check for itself whether the response is gone, the client may leave while its batch runs. Returns false
+    // without queueing when the queue is full. Throws std::invalid_argument when the input does not have one value per input of the model.
+    bool submit(std::vector<T> input, callback_t done, std::shared_ptr<const std::atomic<bool>> cancelled = nullptr) {
+        if ((int)input.size() != inputSize) {
+            throw std::invalid_argument("Expected " + std::to_string(inputSize) + " inputs, got " + std::to_string(input.size()) + ".");
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if ((int)queue.size() >= queueLimit) {
+                rejected++;
+                return false;
+            }
+            queue.push_back(request{ std::move(input), uWS::Loop::get(), std::move(done), nullptr, std::move(cancelled), std::chrono::steady_clock::now() });
+        }
+        signal.notify_one();
+        return true;
+    }
+
+    // Queues a batch request, the inputs of several images one after the other, and calls done with the label and confidence of
+    // each on the event loop of the calling thread. The images run as one forward pass of their own, however many there are.
+    // Cancellation and the queue limit are those of submit. Throws std::invalid_argument when the inputs are not a whole number of images.
+    bool submitBatch(std::vector<T> inputs, batchCallback_t done, std::shared_ptr<const std::atomic<bool>> cancelled = nullptr) {
+        if (inputs.empty() || inputs.size() % inputSize != 0) {
+            throw std::invalid_argument("Expected a multiple of " + std::to_string(inputSize) + " inputs, got " + std::to_string(inputs.size()) + ".");
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if ((int)queue.size() >= queueLimit) {
+                rejected++;
+                return false;
+            }
+            queue.push_back(request{ std::move(inputs), uWS::Loop::get(), nullptr, std::move(done), std::move(cancelled), std::chrono::steady_clock::now() });
+        }
+        signal.notify_one();
+        return true;
+    }
+
+    // Replaces the model, without waiting for the batches that run on the old one, which is freed once the last of them is done.
+    // Throws std::invalid_argument when the new model does not have the inputs and outputs of the old one.
+    void setModel(std::shared_ptr<const MLP<T>> next) {
+        if (next->getInputSize() != inputSize || next->getOutputSize() != outputSize) {
+            throw std::invalid_argument("The model must keep " + std::to_string(inputSize) + " inputs and " + std::to_string(outputSize) + " outputs.");
+        }
+
+        std::atomic_store(&model, std::shared_ptr<const MLP<T>>(std::move(next)));
+    }
+
+    // Returns the batch size and wait time histograms as JSON, with the p50 and p99 wait times taken from the bucket bounds.
+    std::string statistics() const {
+        nlohmann::json stats;
+        stats["maxBatchSize"] = maxBatchSize;
+        stats["maxWaitMicroseconds"] = maxWaitMicroseconds;
+
+        long batches = 0;
+        long requests = 0;
+        nlohmann::json sizes = nlohmann::json::object();
+        for (int n = 1; n <= maxBatchSize; n++) {
+            long count = batchSizes[n];
+            if (count > 0) sizes[std::to_string(n)] = count;
+            batches += count;
+            requests += count * n;
+        }
+        stats["batches"] = batches;
+        stats["requests"] = requests;
+        stats["workers"] = workers.size();
+        stats["rejected"] = rejected.load();
+        stats["cancelled"] = cancelledRequests.load();
+        stats["batchRequests"] = batchRequests.load();
+        stats["batchRequestImages"] = batchRequestImages.load();
+        stats["batchSizes"] = sizes;
+
+        long waits[waitBuckets];
+        long total = 0;
+        nlohmann::json buckets = nlohmann::json::object();
+        for (int b = 0; b < waitBuckets; b++) {
+            waits[b] = waitTimes[b];
+            total += waits[b];
+            if (waits[b] > 0) buckets["<" + std::to_string(1L << b)] = waits[b];
+        }
+        stats["waitMicroseconds"] = buckets;
+
+        auto percentile = [&](double p) {
+            long seen = 0;
+            for (int b = 0; b < waitBuckets; b++) {
+                seen += waits[b];
+                if (total > 0 && seen >= p * total) return 1L << b;
+            }
+            return 0L;
+        };
+        stats["p50WaitMicroseconds"] = percentile(0.5);
+        stats["p99WaitMicroseconds"] = percentile(0.99);
+
+        return stats.dump();
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef JSONPIXELPARSER_CPP
+#define JSONPIXELPARSER_CPP
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Parses a flat JSON array of numbers, the pixels of a JSON /predict body, while it arrives chunk by chunk. Every value is
+// scaled and written straight into the input buffer, which is reserved for exactly the expected number of values up front,
+// so no DOM is built and a flat array allocates nothing after construction. Malformed input, or more values than expected,
+// throw std::invalid_argument from the chunk they are in, before the rest of the body arrives.
+//
+// Built with a maximum number of rows, it parses an array of such arrays instead, the images of a /predict/batch body, into
+// one buffer that holds a row per image. The buffer starts with room for one row, and whenever a row does not fit it doubles,
+// up to maxRows rows, so a body of n rows reallocates about log2(n) times and a small body never holds room for maxRows.
+template <typename T>
+class jsonPixelParser {
+    enum class state { beforeArray, beforeFirstRow, beforeRow, afterRow, beforeFirstValue, beforeValue, inNumber, afterValue, afterArray };
+
+    int expected;
+
+    // Zero for a flat array.
+    int maxRows;
+
+    int rows = 0;
+
+    double scale;
+
+    std::vector<T> values;
+
+    state current = state::beforeArray;
+
+    // The number being read, which may be split across chunks. Pixels never need this many characters.
+    char number[32];
+    int numberLength = 0;
+
+    static bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isNumberCharacter(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    void startNumber(char c) {
+        if (!isNumberCharacter(c)) throw std::invalid_argument(std::string("Unexpected character '") + c + "' in the pixel array.");
+        if ((int)values.size() == (rows + 1) * expected) throw std::invalid_argument("Expected " + std::to_string(expected) + " pixels, got more.");
+
+        number[0] = c;
+        numberLength = 1;
+        current = state::inNumber;
+    }
+
+    void endNumber() {
+        double value;
+        auto [end, error] = std::from_chars(number, number + numberLength, value);
+        if (error != std::errc() || end != number + numberLength) {
+            throw std::invalid_argument("Malformed number '" + std::string(number, numberLength) + "' in the pixel array.");
+        }
+
+        values.push_back((T)(value * scale));
+        current = state::afterValue;
+    }
+
+    void startRow(char c) {
+        if (c != '[') throw std::invalid_argument("Expected a JSON array of pixels per image.");
+        if (rows == maxRows) throw std::invalid_argument("At most " + std::to_string(maxRows) + " images fit in one request.");
+
+        size_t needed = (size_t)(rows + 1) * expected;
+        if (values.capacity() < needed) values.reserve(std::min(std::max(needed, 2 * values.capacity()), (size_t)maxRows * expected));
+
+        current = state::beforeFirstValue;
+    }
+
+    void endRow() {
+        int count = values.size() - (long)rows * expected;
+        if (count != expected) throw std::invalid_argument("Expected " + std::to_string(expected) + " pixels, got " + std::to_string(count) + ".");
+
+        rows++;
+        current = maxRows > 0 ? state::afterRow : state::afterArray;
+    }
+
+public:
+    // Parses an array of expected values, each multiplied by scale on the way into the buffer.
+    jsonPixelParser(int expected, double scale = 1.0) : expected(expected), maxRows(0), scale(scale) {
+        values.reserve(expected);
+    }
+
+    // Parses an array of up to maxRows arrays of expected values each.
+    jsonPixelParser(int expected, int maxRows, double scale) : expected(expected), maxRows(maxRows), scale(scale) {
+        values.reserve(expected);
+    }
+
+    // Parses the next chunk of the body.
+    void consume(std::string_view chunk) {
+        for (char c : chunk) {
+            switch (current) {
+            case state::beforeArray:
+                if (c == '[') current = maxRows > 0 ? state::beforeFirstRow : state::beforeFirstValue;
+                else if (!isWhitespace(c)) throw std::invalid_argument("Expected a JSON array of pixels.");
+                break;
+            case state::beforeFirstRow:
+                if (c == ']') current = state::afterArray;
+                else if (!isWhitespace(c)) startRow(c);
+                break;
+            case state::beforeRow:
+                if (!isWhitespace(c)) startRow(c);
+                break;
+            case state::afterRow:
+                if (c == ',') current = state::beforeRow;
+                else if (c == ']') current = state::afterArray;
+                else if (!isWhitespace(c)) throw std::invalid_argument(std::string("Unexpected character '") + c + "' between images.");
+                break;
+            case state::beforeFirstValue:
+                if (c == ']') endRow();
+                else if (!isWhitespace(c)) startNumber(c);
+                break;
+            case state::beforeValue:
+                if (!isWhitespace(c)) startNumber(c);
+                break;
+            case state::inNumber:
+                if (isNumberCharacter(c)) {
+                    if (numberLength == sizeof(number)) throw std::invalid_argument("A number in the pixel array is too long.");
+                    number[numberLength++] = c;
+                    break;
+                }
+                endNumber();
+                // The character after a number is one of afterValue.
+                [[fallthrough]];
+            case state::afterValue:
+                if (c == ',') current = state::beforeValue;
+                else if (c == ']') endRow();
+                else if (!isWhitespace(c)) throw std::invalid_argument(std::string("Unexpected character '") + c + "' in the pixel array.");
+                break;
+            case state::afterArray:
+                if (!isWhitespace(c)) throw std::invalid_argument("Unexpected data after the pixel array.");
+                break;
+            }
+        }
+    }
+
+    // Returns the values, a row after the other, once the whole body has been consumed. Throws std::invalid_argument when
+    // the array is not complete.
+    std::vector<T> finish() {
+        if (current != state::afterArray) throw std::invalid_argument("The pixel array is not complete.");
+        return std::move(values);
+    }
+
+    // Number of complete rows so far, 1 for a complete flat array.
+    int getRows() const {
+        return rows;
+    }
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef METRICS_CPP
+#define METRICS_CPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide counters and latency histograms of the server, exported in the Prometheus text format by prometheus().
+//
+// Every thread that records gets its own shard, registered the first time it records. Only that thread writes the shard, so a
+// counter is bumped with a relaxed load and store, no lock and no read-modify-write, and recording costs a few nanoseconds.
+// A scrape sums the shards of all threads. The histograms are HDR-style: values below 8 ns get a bucket each, every power of two
+// above is split into 8 buckets, so any value is within 12.5% of its bucket's bounds from 1 ns up to about a minute.
+class metrics {
+
+public:
+    // The stages a request goes through, each with its own latency histogram. The layers of the forward pass follow layer0,
+    // up to maxLayers of them.
+    enum stage { receive, parse, queue, write, total, layer0 };
+
+    static const int maxLayers = 16;
+
+    static const int stageCount = layer0 + maxLayers;
+
+    enum counter {
+        predictRequests, batchRequests, otherRequests, aborts, badRequests, rejected, failures, started, finished,
+        streamsOpened, streamsClosed, streamUpdates, coalescedUpdates, counterCount
+    };
+
+private:
+    static const int subBuckets = 8;
+
+    static const int subBucketBits = 3;
+
+    // 2^36 ns, about 69 seconds, longer values fall into the last bucket.
+    static const int maxExponent = 36;
+
+    static const int bucketCount = subBuckets + (maxExponent - subBucketBits + 1) * subBuckets;
+
+    struct shard {
+        std::atomic<uint64_t> counters[counterCount] = {};
+        std::atomic<uint64_t> buckets[stageCount][bucketCount] = {};
+        std::atomic<uint64_t> sums[stageCount] = {};
+    };
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<shard>> shards;
+
+    // Number of layers the model had the last time layer times were recorded.
+    std::atomic<int> layers{ 0 };
+
+    metrics() = default;
+
+    shard& local() {
+        thread_local shard* mine = nullptr;
+        if (mine == nullptr) {
+            std::lock_guard<std::mutex> guard(lock);
+            shards.push_back(std::make_unique<shard>());
+            mine = shards.back().get();
+        }
+        return *mine;
+    }
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static int bucket(uint64_t nanoseconds) {
+        if (nanoseconds < subBuckets) return nanoseconds;
+
+        int exponent = 63 - __builtin_clzll(nanoseconds);
+        if (exponent > maxExponent) return bucketCount - 1;
+        int sub = (nanoseconds >> (exponent - subBucketBits)) & (subBuckets - 1);
+        return subBuckets + (exponent - subBucketBits) * subBuckets + sub;
+    }
+
+    // The largest value of a bucket, in nanoseconds.
+    static uint64_t upperBound(int bucket) {
+        if (bucket < subBuckets) return bucket;
+
+        int exponent = (bucket - subBuckets) / subBuckets + subBucketBits;
+        uint64_t sub = (bucket - subBuckets) % subBuckets;
+        return ((subBuckets + sub + 1) << (exponent - subBucketBits)) - 1;
+    }
+
+    static std::string stageName(int s) {
+        switch (s) {
+        case receive: return "receive";
+        case parse: return "parse";
+        case queue: return "queue";
+        case write: return "write";
+        case total: return "total";
+        default: return "layer" + std::to_string(s - layer0);
+        }
+    }
+
+    static std::string number(double value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+
+public:
+    static metrics& getInstance() {
+        static metrics instance;
+        return instance;
+    }
+
+    metrics(const metrics&) = delete;
+
+    metrics& operator=(const metrics&) = delete;
+
+    void count(counter c, uint64_t amount = 1) {
+        bump(local().counters[c], amount);
+    }
+
+    // Records one value of a stage, in nanoseconds.
+    void record(int s, uint64_t nanoseconds) {
+        shard& mine = local();
+        bump(mine.buckets[s][bucket(nanoseconds)], 1);
+        bump(mine.sums[s], nanoseconds);
+    }
+
+    void record(int s, std::chrono::steady_clock::duration time) {
+        record(s, (uint64_t)std::max<long long>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()));
+    }
+
+    // Records the time of every layer of one forward pass, see MLP::inferenceBuffers.
+    void recordLayers(const std::vector<long>& layerNanoseconds) {
+        int count = std::min((int)layerNanoseconds.size(), maxLayers);
+        for (int l = 0; l < count; l++) {
+            record(layer0 + l, (uint64_t)layerNanoseconds[l]);
+        }
+        layers.store(count, std::memory_order_relaxed);
+    }
+
+    // Returns every counter and histogram in the Prometheus text exposition format. Histograms are exported with a bucket per power
+    // of two, their quantiles are computed from the full resolution buckets.
+    std::string prometheus() {
+        uint64_t counters[counterCount] = {};
+        std::vector<std::vector<uint64_t>> buckets(stageCount, std::vector<uint64_t>(bucketCount));
+        std::vector<uint64_t> sums(stageCount);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (const auto& s : shards) {
+                for (int c = 0; c < counterCount; c++) counters[c] += s->counters[c].load(std::memory_order_relaxed);
+                for (int st = 0; st < stageCount; st++) {
+                    sums[st] += s->sums[st].load(std::memory_order_relaxed);
+                    for (int b = 0; b < bucketCount; b++) buckets[st][b] += s->buckets[st][b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::string out;
+        auto line = [&](const std::string& text) { out += text + "\n"; };
+
+        line("# HELP digits_requests_total Requests received, by route.");
+        line("# TYPE digits_requests_total counter");
+        line("digits_requests_total{route=\"/predict\"} " + std::to_string(counters[predictRequests]));
+        line("digits_requests_total{route=\"/predict/batch\"} " + std::to_string(counters[batchRequests]));
+        line("digits_requests_total{route=\"other\"} " + std::to_string(counters[otherRequests]));
+
+        line("# HELP digits_aborts_total Requests whose client left before the response.");
+        line("# TYPE digits_aborts_total counter");
+        line("digits_aborts_total " + std::to_string(counters[aborts]));
+
+        line("# HELP digits_errors_total Prediction requests answered with an error, by status.");
+        line("# TYPE digits_errors_total counter");
+        line("digits_errors_total{status=\"400\"} " + std::to_string(counters[badRequests]));
+        line("digits_errors_total{status=\"500\"} " + std::to_string(counters[failures]));
+        line("digits_errors_total{status=\"503\"} " + std::to_string(counters[rejected]));
+
+        // Both counters are summed over threads that may be writing them, a request that finishes during the scrape may be seen
+        // finished but not started.
+        line("# HELP digits_in_flight_requests Prediction requests received and not yet answered or aborted.");
+        line("# TYPE digits_in_flight_requests gauge");
+        line("digits_in_flight_requests " + std::to_string(counters[started] > counters[finished] ? counters[started] - counters[finished] : 0));
+
+        line("# HELP digits_stream_connections Open WebSocket prediction streams.");
+        line("# TYPE digits_stream_connections gauge");
+        line("digits_stream_connections " + std::to_string(counters[streamsOpened] > counters[streamsClosed] ? counters[streamsOpened] - counters[streamsClosed] : 0));
+
+        line("# HELP digits_stream_updates_total Images received on prediction streams.");
+        line("# TYPE digits_stream_updates_total counter");
+        line("digits_stream_updates_total " + std::to_string(counters[streamUpdates]));
+
+        line("# HELP digits_stream_coalesced_total Stream images replaced by a newer one before they were predicted.");
+        line("# TYPE digits_stream_coalesced_total counter");
+        line("digits_stream_coalesced_total " + std::to_string(counters[coalescedUpdates]));
+
+        int stages = layer0 + layers.load(std::memory_order_relaxed);
+        line("# HELP digits_stage_seconds Time of each stage of a request, the layers are timed per batch.");
+        line("# TYPE digits_stage_seconds histogram");
+        for (int st = 0; st < stages; st++) {
+            std::string label = "stage=\"" + stageName(st) + "\"";
+            uint64_t seen = 0;
+            for (int b = 0; b < bucketCount; b++) {
+                seen += buckets[st][b];
+                // One bucket per power of two, at the last sub-bucket of each.
+                if (b >= subBuckets - 1 && (b + 1) % subBuckets == 0) {
+                    line("digits_stage_seconds_bucket{" + label + ",le=\"" + number((upperBound(b) + 1) * 1e-9) + "\"} " + std::to_string(seen));
+                }
+            }
+            line("digits_stage_seconds_bucket{" + label + ",le=\"+Inf\"} " + std::to_string(seen));
+            line("digits_stage_seconds_sum{" + label + "} " + number(sums[st] * 1e-9));
+            line("digits_stage_seconds_count{" + label + "} " + std::to_string(seen));
+        }
+
+        line("# HELP digits_stage_quantile_seconds Quantiles of the time of each stage, from the full resolution histograms.");
+        line("# TYPE digits_stage_quantile_seconds gauge");
+        for (int st = 0; st < stages; st++) {
+            uint64_t total = 0;
+            for (int b = 0; b < bucketCount; b++) total += buckets[st][b];
+            for (double q : { 0.5, 0.9, 0.99, 0.999 }) {
+                uint64_t seen = 0;
+                int b = 0;
+                while (b < bucketCount - 1 && (total == 0 || seen + buckets[st][b] < q * total)) seen += buckets[st][b++];
+                double value = total == 0 ? 0 : upperBound(b) * 1e-9;
+                line("digits_stage_quantile_seconds{stage=\"" + stageName(st) + "\",quantile=\"" + number(q) + "\"} " + number(value));
+            }
+        }
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef MODELRELOADER_CPP
+#define MODELRELOADER_CPP
+
+#include <batchScheduler.cpp>
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+// Reloads the served model from its weights file without taking the server down. A reload is requested through reload(), or
+// happens on its own when the file changes, checked every pollMilliseconds. The file is loaded on a thread of the reloader, so
+// neither the event loops nor the workers of the scheduler wait for it, and the new model is then swapped into the scheduler.
+// Batches already running finish on the old model, which is freed once the last of them is done with it. A file that fails to
+// load leaves the current model in place.
+template <typename T>
+class modelReloader {
+
+public:
+    // Reads the weights file into a model ready to be served. Throws when the file does not hold a valid model.
+    typedef std::function<std::shared_ptr<const MLP<T>>(const std::string& path)> loader_t;
+
+private:
+    batchScheduler<T>& scheduler;
+
+    std::string path;
+
+    loader_t load;
+
+    // Zero when the file is not watched.
+    long pollMilliseconds;
+
+    mutable std::mutex lock;
+    std::condition_variable signal;
+    bool requested = false;
+    bool stopping = false;
+
+    // The state reported by status, guarded by lock.
+    long version = 1;
+    long reloads = 0;
+    long failedReloads = 0;
+    double lastReloadMilliseconds = 0;
+    std::time_t loadedAt;
+    std::string lastError;
+
+    std::thread worker;
+
+    // The modification time and size of the file, which tell a changed file apart. Reads nothing when the file is missing.
+    bool fileStamp(std::filesystem::file_time_type& time, std::uintmax_t& size) const {
+        std::error_code error;
+        time = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+        size = std::filesystem::file_size(path, error);
+        return !error;
+    }
+
+    void reloadNow() {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            scheduler.setModel(load(path));
+            std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+
+            std::lock_guard<std::mutex> guard(lock);
+            version++;
+            reloads++;
+            lastReloadMilliseconds = time.count();
+            loadedAt = std::time(nullptr);
+            lastError.clear();
+            std::cout << "Loaded model version " << version << " from " << path << " in " << time.count() << " ms." << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::lock_guard<std::mutex> guard(lock);
+            failedReloads++;
+            lastError = e.what();
+            std::cerr << "Failed to reload " << path << ": " << e.what() << std::endl;
+        }
+    }
+
+    // Waits for a requested reload or a change of the file, until the reloader is destroyed. A changed file is only loaded once
+    // it has stayed the same for a whole poll interval, so a file that is still being written is not picked up half way.
+    void run() {
+        std::filesystem::file_time_type loadedTime, seenTime;
+        std::uintmax_t loadedSize = 0, seenSize = 0;
+        fileStamp(loadedTime, loadedSize);
+        seenTime = loadedTime;
+        seenSize = loadedSize;
+
+        while (true) {
+            bool reload = false;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                auto wake = [&]() { return stopping || requested; };
+                if (pollMilliseconds > 0) signal.wait_for(guard, std::chrono::milliseconds(pollMilliseconds), wake);
+                else signal.wait(guard, wake);
+                if (stopping) return;
+
+                reload = requested;
+                requested = false;
+            }
+
+            std::filesystem::file_time_type time;
+            std::uintmax_t size;
+            if (pollMilliseconds > 0 && fileStamp(time, size)) {
+                bool settled = time == seenTime && size == seenSize;
+                if (settled && (time != loadedTime || size != loadedSize)) reload = true;
+                seenTime = time;
+                seenSize = size;
+            }
+
+            if (reload) {
+                fileStamp(loadedTime, loadedSize);
+                reloadNow();
+            }
+        }
+    }
+
+public:
+    // The model the scheduler was built with counts as version 1, loaded from path.
+    modelReloader(batchScheduler<T>& scheduler, std::string path, loader_t load, long pollMilliseconds)
+        : scheduler(scheduler), path(std::move(path)), load(std::move(load)), pollMilliseconds(pollMilliseconds), loadedAt(std::time(nullptr)) {
+        worker = std::thread([this]() { run(); });
+    }
+
+    ~modelReloader() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        signal.notify_all();
+        worker.join();
+    }
+
+    modelReloader(const modelReloader&) = delete;
+
+    modelReloader& operator=(const modelReloader&) = delete;
+
+    // Asks for a reload of the file and returns right away, see status for its outcome.
+    void reload() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            requested = true;
+        }
+        signal.notify_one();
+    }
+
+    // Returns the current model version, when it was loaded, how long the last reload took, and the error of the last failed one, as JSON.
+    std::string status() const {
+        std::lock_guard<std::mutex> guard(lock);
+        nlohmann::json status;
+        status["version"] = version;
+        status["path"] = path;
+        status["loadedAt"] = (long)loadedAt;
+        status["reloads"] = reloads;
+        status["failedReloads"] = failedReloads;
+        status["lastReloadMilliseconds"] = lastReloadMilliseconds;
+        status["watching"] = pollMilliseconds > 0;
+        if (!lastError.empty()) status["lastError"] = lastError;
+        return status.dump();
+    }
+};
+
+#endif
@@ -4,7 +4,7 @@
 #include <fstream>
 
 // Helper function for writing weights and biases to text file
-void writeToFile(std::string fileName, matrix inputWeights, matrix outputBiases, std::vector<hiddenLayer> hiddenLayers) {
+void writeToFile(const std::string& fileName, const matrix& inputWeights, const matrix& outputBiases, const std::vector<hiddenLayer<>>& hiddenLayers) {
     std::ofstream outFile(fileName);
 
     outFile << "inputWeights" << std::endl;
@@ -45,7 +45,13 @@ void writeToFile(std::string fileName, matrix inputWeights, matrix outputBiases,
 
 }
 
-int main() {
+// The batch size can be given as the first argument, it defaults to per-example training. The number of
+// data parallel workers can be given as the second argument, followed by "hogwild" to train asynchronously.
+int main(int argc, char** argv) {
+    int batchSize = argc > 1 ? std::stoi(argv[1]) : 1;
+    int workers = argc > 2 ? std::stoi(argv[2]) : 1;
+    bool hogwild = argc > 3 && std::string(argv[3]) == "hogwild";
+
     // Read in training and test data/labels
     auto [trainInputs, trainLabels] = csv::read_data("../../train/mnist_train.csv", 10);
     auto [testInputs, testLabels] = csv::read_data("../../train/mnist_test.csv", 10);
@@ -58,7 +64,7 @@ int main() {
     MLP model = MLP(784, 10, std::vector<int>{392, 196, 98, 49, 24});
 
     // Train model
-    auto [inputWeights, outputBiases, hiddenLayers, _] = model.train(trainInputs, trainLabels, 0.05, 100, 0.0005);
+    auto [inputWeights, outputBiases, hiddenLayers, _] = model.train(trainInputs, trainLabels, 0.05, 100, 0.0005, batchSize, workers, hogwild);
 
     // Test model
     model.test(testInputs, testLabels);
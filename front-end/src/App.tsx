@@ -12,6 +12,9 @@ function App() {
   const [buttonTimeout, setButtonTimeout] = useState<number>(0);
   const [isWaiting, setIsWaiting] = useState<boolean>(false);
 
+  // Live predictions while drawing, the server answers every image streamed to it with its guess
+  const stream = useRef<WebSocket | null>(null)
+
   const getCoords = (e: React.MouseEvent<HTMLCanvasElement>) => {
     const rect = canvas?.current?.getBoundingClientRect()
     if (rect) {
@@ -50,7 +53,23 @@ function App() {
       if (ctx && miniCtx) {
         miniCtx.clearRect(0, 0, 28, 28)
         miniCtx.drawImage(canvas.current, 0, 0, miniCanvas.current.width, miniCanvas.current.height)
+        streamImage()
+      }
+    }
+  }
+
+  // Sends the mini-canvas as 784 raw pixels, the server only predicts the newest image it has been sent
+  const streamImage = () => {
+    if (stream.current?.readyState !== WebSocket.OPEN || !miniCanvas?.current) return
+
+    const miniCtx = miniCanvas.current.getContext('2d')
+    if (miniCtx) {
+      const imgData = miniCtx.getImageData(0, 0, 28, 28).data
+      const pixels = new Uint8Array(784)
+      for (let i = 0; i < imgData.length; i += 4) {
+        pixels[i / 4] = imgData[i + 3]
       }
+      stream.current.send(pixels)
     }
   }
 
@@ -116,6 +135,21 @@ function App() {
     return guess
   }
 
+  // Open the prediction stream, the submit button still works without it
+  useEffect(() => {
+    try {
+      const socket = new WebSocket('Neural-Net-Stream-Endpoint')
+      socket.onmessage = (event) => {
+        const data = JSON.parse(event.data)
+        if (data.label !== undefined) setGuess(data.label)
+      }
+      stream.current = socket
+      return () => socket.close()
+    } catch (err) {
+      console.log(err)
+    }
+  }, [])
+
   // Initialize line style for drawing on canvas
   useEffect(() => {
     if (canvas?.current && miniCanvas?.current) {